@@ -52,7 +52,7 @@ using namespace sux;
  */
 
 template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectHalf {
-  private:
+  protected:
 	static const int log2_ones_per_inventory = 10;
 	static const int ones_per_inventory = 1 << log2_ones_per_inventory;
 	static const int ones_per_inventory_mask = ones_per_inventory - 1;
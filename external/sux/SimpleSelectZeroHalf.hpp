@@ -52,7 +52,7 @@ using namespace sux;
  */
 
 template <util::AllocType AT = util::AllocType::MALLOC> class SimpleSelectZeroHalf {
-  private:
+  protected:
 	static const int log2_zeros_per_inventory = 10;
 	static const int zeros_per_inventory = 1 << log2_zeros_per_inventory;
 	static const uint64_t zeros_per_inventory_mask = zeros_per_inventory - 1;
@@ -0,0 +1,168 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  build_profiler.hpp: per-phase resource report of the index construction (-P)
+ */
+
+#ifndef BUILD_PROFILER_HPP_
+#define BUILD_PROFILER_HPP_
+
+#include <sys/resource.h>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <common.hpp>
+
+// Per-phase resource report of a construction: wall and CPU time, peak heap, bytes read
+// and written and size of the phase output. Phases are opened with build_profiler::phase
+// and may overlap when they run concurrently: the CPU time, the heap peak and the I/O
+// volume are those of the whole process, so they cover every phase running at the time
+class build_profiler
+{
+public:
+    // malloc_count_peak and malloc_count_reset_peak, set by the executables that link
+    // malloc_count; without them no peak heap is reported
+    std::function<usafe_t()> heap_peak;
+    std::function<void()> heap_reset_peak;
+
+    // measures a phase from its construction to its destruction; p may be nullptr
+    class phase
+    {
+    public:
+        phase(build_profiler* p_, const std::string& name_) : p(p_), name(name_)
+        {
+            if(p != nullptr) id = p->begin(name);
+        }
+        ~phase(){ if(p != nullptr) p->end(id, bytes); }
+
+        phase(const phase&) = delete;
+        phase& operator=(const phase&) = delete;
+
+        // bytes taken by the output of the phase
+        void output(usafe_t bytes_){ bytes = bytes_; }
+
+    private:
+        build_profiler* p;
+        std::string name;
+        usafe_t id = 0, bytes = 0;
+    };
+
+    // set the output size of the completed phases called name, e.g. once serialized
+    void output(const std::string& name, usafe_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for(auto& r : records) if(r.name == name) r.output = bytes;
+    }
+
+    void print_table(std::ostream& out) const
+    {
+        const double MiB = 1 << 20;
+        out << "[INFO] Build profile:" << std::endl << std::fixed << std::setprecision(2)
+            << "		" << std::left << std::setw(12) << "phase" << std::right << std::setw(11) << "wall (s)"
+            << std::setw(10) << "cpu (s)" << std::setw(13) << "heap (MiB)" << std::setw(13) << "read (MiB)"
+            << std::setw(14) << "written (MiB)" << std::setw(13) << "output (MiB)" << std::endl;
+        for(auto& r : records)
+        {
+            out << "		" << std::left << std::setw(12) << r.name << std::right << std::setw(11) << r.wall
+                << std::setw(10) << r.cpu << std::setw(13);
+            if(heap_peak) out << r.heap / MiB; else out << "-";
+            out << std::setw(13) << r.read / MiB << std::setw(14) << r.written / MiB
+                << std::setw(13) << r.output / MiB << std::endl;
+        }
+        out << "		→ Total wall time = " << total_wall() << " s, peak RSS = " << peak_rss() / MiB << " MiB"
+            << "\n" << std::endl;
+        out.unsetf(std::ios::floatfield); out << std::setprecision(6);
+    }
+
+    void write_json(std::ostream& out) const
+    {
+        out << "{\n  \"phases\": [";
+        for(usafe_t i = 0; i < records.size(); ++i)
+        {
+            auto& r = records[i];
+            out << (i ? "," : "") << "\n    {\"name\": \"" << r.name << "\", \"wall_s\": " << r.wall
+                << ", \"cpu_s\": " << r.cpu << ", \"peak_heap_bytes\": ";
+            if(heap_peak) out << r.heap; else out << "null";
+            out << ", \"read_bytes\": " << r.read << ", \"written_bytes\": " << r.written
+                << ", \"output_bytes\": " << r.output << "}";
+        }
+        out << "\n  ],\n  \"total_wall_s\": " << total_wall() << ",\n  \"peak_rss_bytes\": " << peak_rss() << "\n}" << std::endl;
+    }
+
+    // peak resident set size of the process in bytes
+    static usafe_t peak_rss()
+    {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+        return ru.ru_maxrss;
+#else
+        return ru.ru_maxrss * 1024;
+#endif
+    }
+
+private:
+
+    struct snapshot { double wall, cpu; usafe_t read, written; };
+    struct record { std::string name; snapshot start; double wall = 0, cpu = 0; usafe_t heap = 0, read = 0, written = 0, output = 0; };
+
+    std::vector<record> records;
+    usafe_t active = 0; // phases in progress
+    double first = -1, last = 0; // wall clock at the first begin and at the last end
+    mutable std::mutex mtx;
+
+    usafe_t begin(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(active++ == 0 and heap_reset_peak) heap_reset_peak();
+        record r; r.name = name; r.start = now();
+        if(first < 0) first = r.start.wall;
+        records.push_back(r);
+        return records.size()-1;
+    }
+
+    void end(usafe_t id, usafe_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        snapshot s = now();
+        record& r = records[id];
+        r.wall = s.wall - r.start.wall; r.cpu = s.cpu - r.start.cpu;
+        r.read = s.read - r.start.read; r.written = s.written - r.start.written;
+        r.heap = heap_peak ? heap_peak() : 0;
+        r.output = bytes;
+        last = s.wall;
+        --active;
+    }
+
+    double total_wall() const { return first < 0 ? 0 : last - first; }
+
+    // wall clock, CPU time of all threads and bytes read and written through system
+    // calls (Linux only: mapped files are not counted)
+    static snapshot now()
+    {
+        snapshot s;
+        s.wall = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        s.cpu = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+        s.read = s.written = 0;
+        std::ifstream io("/proc/self/io");
+        std::string key; usafe_t v;
+        while(io >> key >> v)
+        {
+            if(key == "rchar:") s.read = v;
+            else if(key == "wchar:") s.written = v;
+        }
+        return s;
+    }
+
+};
+
+#endif
@@ -11,6 +11,11 @@
 
 #include <sys/stat.h>
 #include <cassert>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
 
 #include <sdsl/int_vector.hpp>
 
@@ -46,7 +51,7 @@ static unsigned char dna_to_code_table[128] = {
     4, 4, 4, 4,  3, 4, 4, 4,  4, 4, 4, 4,  4, 4, 4, 5
 };
 
-static unsigned char code_to_dna_table[4] = {'A','C','G','T'};
+static const unsigned char code_to_dna_table[4] = {'A','C','G','T'};
 
 static unsigned char bit_mask_table[16] = {
     0,   0,   0,   0, 
@@ -68,7 +73,7 @@ void inline set_uint_DNA(uchar_t* t, std::string& p)
     uchar_t offset = 4-(p.size()%4);
     for(uint_t i=0;i<p.size();++i)
         t[bytes-(i/4)] |= 
-        bit_mask_table[(dna_to_code_table[p[i]]*4)+((offset+i)%4)];
+        bit_mask_table[(dna_to_code_table[(uchar_t)p[i]]*4)+((offset+i)%4)];
 }
 void inline set_uint_DNA_inv(uchar_t* t, std::string& p)
 {
@@ -76,7 +81,7 @@ void inline set_uint_DNA_inv(uchar_t* t, std::string& p)
     uchar_t offset = 4-(size%4); 
     for(uint_t i=0;i<size;++i)
         t[((size-i-1)/4)] |= 
-        bit_mask_table[(dna_to_code_table[p[size-i-1]]*4)+((offset+i)%4)];
+        bit_mask_table[(dna_to_code_table[(uchar_t)p[size-i-1]]*4)+((offset+i)%4)];
 }
 void inline set_uint_DNA_inv(uchar_t* t, std::string& p, uchar_t len, 
                                             uint_t beg, uchar_t plen)
@@ -86,7 +91,7 @@ void inline set_uint_DNA_inv(uchar_t* t, std::string& p, uchar_t len,
     uchar_t offset = 4-(size%4);
     for(uint_t i=0;i<plen;++i)
         t[((size-i-1)/4)] |= 
-        bit_mask_table[(dna_to_code_table[p[beg+plen-i-1]]*4)+((offset+i)%4)];
+        bit_mask_table[(dna_to_code_table[(uchar_t)p[beg+plen-i-1]]*4)+((offset+i)%4)];
 }
 
 usafe_t get_5bytes_uint(uchar_t *a, uint_t i=0)
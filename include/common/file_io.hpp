@@ -0,0 +1,146 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  file_io.hpp: memory-mapped input files, readers and writers of packed integer files
+ */
+
+#ifndef FILE_IO_HPP_
+#define FILE_IO_HPP_
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <common.hpp>
+
+// read-only memory map of a whole file, unmapped when destroyed
+class mapped_file
+{
+public:
+    mapped_file(const std::string& path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd < 0 or fstat(fd, &st) != 0)
+        {
+            std::cerr << "Error: Could not open " << path << std::endl;
+            exit(1);
+        }
+        len = st.st_size;
+        if(len > 0)
+        {
+            void* p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(p == MAP_FAILED)
+            {
+                std::cerr << "Error: Could not map " << path << std::endl;
+                exit(1);
+            }
+            ptr = (const uchar_t*)p;
+        }
+        close(fd);
+    }
+
+    ~mapped_file(){ if(ptr != nullptr) munmap((void*)ptr, len); }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const uchar_t* data() const { return ptr; }
+    usafe_t size() const { return len; }
+
+    // access pattern hint: sequential read-ahead or random access
+    void advise_sequential(bool_t sequential) const
+    {
+        if(ptr != nullptr) madvise((void*)ptr, len, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+    }
+
+private:
+    const uchar_t* ptr = nullptr;
+    usafe_t len = 0;
+};
+
+// sequential reader of a file of little-endian unsigned integers of bytes bytes each:
+// 5 for the 40-bit packed files written by stpd_small, 8 for native 64-bit files
+class int_file_reader
+{
+public:
+    int_file_reader(const std::string& path, usafe_t bytes_) : in(path, std::ios::binary), bytes(bytes_)
+    {
+        if(not in.is_open())
+        {
+            std::cerr << "Error: Could not open " << path << std::endl;
+            exit(1);
+        }
+        if(bytes == 0 or bytes > 8)
+        {
+            std::cerr << "Error: unsupported integer width of " << bytes << " bytes" << std::endl;
+            exit(1);
+        }
+        in.seekg(0, std::ios::end);
+        n = static_cast<usafe_t>(in.tellg()) / bytes;
+        in.seekg(0, std::ios::beg);
+    }
+
+    // number of integers in the file
+    usafe_t size() const { return n; }
+
+    bool_t next(usafe_t& x)
+    {
+        uchar_t b[8] = {0};
+        if(not in.read(reinterpret_cast<char*>(b), bytes)) return false;
+        x = 0;
+        for(usafe_t j = bytes; j-- > 0;) x = (x << 8) | b[j];
+        return true;
+    }
+
+private:
+    std::ifstream in;
+    usafe_t bytes, n = 0;
+};
+
+// sequential writer of the files read by int_file_reader
+class int_file_writer
+{
+public:
+    int_file_writer(const std::string& path, usafe_t bytes_) : out(path, std::ios::binary), bytes(bytes_)
+    {
+        if(not out.is_open())
+        {
+            std::cerr << "Error: Could not open " << path << std::endl;
+            exit(1);
+        }
+        if(bytes == 0 or bytes > 8)
+        {
+            std::cerr << "Error: unsupported integer width of " << bytes << " bytes" << std::endl;
+            exit(1);
+        }
+    }
+
+    void push(usafe_t x)
+    {
+        uchar_t b[8];
+        for(usafe_t j = 0; j < bytes; ++j, x >>= 8) b[j] = x & 0xFF;
+        out.write(reinterpret_cast<char*>(b), bytes);
+    }
+
+    void close()
+    {
+        out.close();
+        if(out.fail())
+        {
+            std::cerr << "Error: Could not write the integer file" << std::endl;
+            exit(1);
+        }
+    }
+
+private:
+    std::ofstream out;
+    usafe_t bytes;
+};
+
+#endif
@@ -0,0 +1,59 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  parallel.hpp: parallel loops and sorting over std::thread
+ */
+
+#ifndef PARALLEL_HPP_
+#define PARALLEL_HPP_
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <common.hpp>
+
+// split [0,n) into one contiguous chunk per thread and run f(begin,end) on each
+template<class F>
+void parallel_for(usafe_t n, usafe_t threads, F f)
+{
+    if(threads <= 1 || n < threads) { f(0, n); return; }
+
+    std::vector<std::thread> workers;
+    usafe_t chunk = (n+threads-1)/threads;
+    for(usafe_t b = 0; b < n; b += chunk)
+        workers.emplace_back(f, b, std::min(n, b+chunk));
+    for(auto& w : workers) { w.join(); }
+}
+
+// sort [first,last) with up to threads threads: one chunk per thread is sorted
+// concurrently, then adjacent sorted chunks are merged pairwise, also concurrently
+template<class It, class Compare>
+void parallel_sort(It first, It last, Compare cmp, usafe_t threads)
+{
+    usafe_t n = last - first;
+    if(threads <= 1 or n < 2*threads) { std::sort(first, last, cmp); return; }
+
+    std::vector<usafe_t> bounds;
+    usafe_t chunk = (n+threads-1)/threads;
+    for(usafe_t b = 0; b < n; b += chunk) bounds.push_back(b);
+    bounds.push_back(n);
+
+    parallel_for(bounds.size()-1, threads, [&](usafe_t b, usafe_t e){
+        for(usafe_t k = b; k < e; ++k) std::sort(first+bounds[k], first+bounds[k+1], cmp);
+    });
+    while(bounds.size() > 2)
+    {
+        parallel_for((bounds.size()-1)/2, threads, [&](usafe_t b, usafe_t e){
+            for(usafe_t k = b; k < e; ++k)
+                std::inplace_merge(first+bounds[2*k], first+bounds[2*k+1], first+bounds[2*k+2], cmp);
+        });
+        std::vector<usafe_t> merged;
+        for(usafe_t k = 0; k < bounds.size(); k += 2) merged.push_back(bounds[k]);
+        if(merged.back() != n) merged.push_back(n);
+        bounds.swap(merged);
+    }
+}
+
+#endif
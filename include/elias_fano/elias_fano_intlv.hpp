@@ -42,6 +42,36 @@ namespace sux::bits {
 using namespace std;
 using namespace sux;
 
+/** SimpleSelectHalf and SimpleSelectZeroHalf with a prefetch of the inventory entry read
+ *  first by select(rank) and selectZero(rank), see InterleavedEliasFano::prefetch_successor.
+ *  The layout and the serialization are those of the base classes.
+ */
+template <util::AllocType AT = util::AllocType::MALLOC> class PrefetchSelectHalf : public SimpleSelectHalf<AT> {
+	typedef SimpleSelectHalf<AT> base;
+  public:
+	using base::base;
+
+	void prefetch(const uint64_t rank) const {
+		const uint64_t inventory_index = rank >> base::log2_ones_per_inventory;
+		const int64_t *inventory_start = &this->inventory + (inventory_index << base::log2_longwords_per_subinventory) + inventory_index;
+		__builtin_prefetch(inventory_start);
+		__builtin_prefetch(inventory_start + base::longwords_per_subinventory);
+	}
+};
+
+template <util::AllocType AT = util::AllocType::MALLOC> class PrefetchSelectZeroHalf : public SimpleSelectZeroHalf<AT> {
+	typedef SimpleSelectZeroHalf<AT> base;
+  public:
+	using base::base;
+
+	void prefetch(const uint64_t rank) const {
+		const uint64_t inventory_index = rank >> base::log2_zeros_per_inventory;
+		const int64_t *inventory_start = &this->inventory + (inventory_index << base::log2_longwords_per_subinventory) + inventory_index;
+		__builtin_prefetch(inventory_start);
+		__builtin_prefetch(inventory_start + base::longwords_per_subinventory);
+	}
+};
+
 /** An implementation of selection and ranking based on the Elias-Fano representation
  *  of a monotone sequence of integers interleaved by a fixed amount of bites.
  *
@@ -51,17 +81,18 @@ using namespace sux;
 template <util::AllocType AT = util::AllocType::MALLOC> class InterleavedEliasFano : public Rank, public Select {
   private:
 	util::Vector<uint64_t, AT> lower_bits, upper_bits;
-	SimpleSelectHalf<AT> select_upper;
-	SimpleSelectZeroHalf<AT> selectz_upper;
+	PrefetchSelectHalf<AT> select_upper;
+	PrefetchSelectZeroHalf<AT> selectz_upper;
 	uint64_t u, n;
 	int l, w;
 	uint64_t lower_l_bits_mask;
 	uint8_t u_width;
+	uint64_t pushed = 0; // pairs appended by push_back()
 
 	__inline static void set(util::Vector<uint64_t, AT> &bits, const uint64_t pos) { bits[pos / 64] |= 1ULL << pos % 64; }
 
 	__inline static uint64_t get_bits(const util::Vector<uint64_t, AT> &bits, const uint64_t start, const int width) {
-		const int start_word = start / 64;
+		const uint64_t start_word = start / 64;
 		const int start_bit = start % 64;
 		const int total_offset = start_bit + width;
 		const uint64_t result = bits[start_word] >> start_bit;
@@ -114,10 +145,27 @@ template <util::AllocType AT = util::AllocType::MALLOC> class InterleavedEliasFa
  	void build(const std::vector<std::pair<uint64_t,uint64_t>>& keys_values,
  		         const uint64_t universe_size, const uint8_t  values_width)
 	{
-		this->n = keys_values.size();
+		init(keys_values.size(), universe_size, values_width);
+		for (uint64_t i = 0; i < n; ++i)
+			push_back(keys_values[i].first, keys_values[i].second);
+		finalize();
+	}
+
+	/** Incremental construction: init() allocates the structure for n pairs,
+	 *  push_back() appends them in monotonically increasing key order and
+	 *  finalize() builds the select structures once all pairs have been appended.
+	 *
+	 * @param n_ number of (key, value) pairs.
+	 * @param universe_size size of the largest key that can be represented.
+	 * @param width_values number of bits need to represent each values.
+	 */
+	void init(const uint64_t n_, const uint64_t universe_size, const uint8_t values_width)
+	{
+		this->n = n_;
 		this->u = universe_size;
 		this->l = n == 0 ? 0 : max(0, lambda_safe(u / n));
 		this->w = values_width;
+		this->pushed = 0;
 
     #ifdef DEBUG
       std::cout << "Universe size: " << u << std::endl;
@@ -126,23 +174,25 @@ template <util::AllocType AT = util::AllocType::MALLOC> class InterleavedEliasFa
 			std::cout << "Lower bits: " << n * (l + w) << std::endl;
 		#endif
 
-		const uint64_t lower_bits_mask = (1ULL << l) - 1;
+		this->lower_l_bits_mask = (1ULL << l) - 1;
 
 		// parchè + 2 * (l == 0) ? 
 		lower_bits.size(((n * (l + w)) + 63) / 64 );
 		upper_bits.size(((n + (u >> l) + 1) + 63) / 64);
+	}
 
-		for (uint64_t i = 0; i < n; ++i)
-		{
-			if (l != 0) set_bits(lower_bits, i * (l + w), l, keys_values[i].first & lower_bits_mask);
-			set_bits(lower_bits,(i * (l + w))+l, w, keys_values[i].second);
-			set(upper_bits, (keys_values[i].first >> l) + i);
-		}
-
-		select_upper = SimpleSelectHalf<>(&upper_bits, n + (u >> l) + 1);
-		selectz_upper = SimpleSelectZeroHalf<>(&upper_bits, n + (u >> l) + 1);
+	void push_back(const uint64_t key, const uint64_t value)
+	{
+		const uint64_t i = pushed++;
+		if (l != 0) set_bits(lower_bits, i * (l + w), l, key & lower_l_bits_mask);
+		set_bits(lower_bits,(i * (l + w))+l, w, value);
+		set(upper_bits, (key >> l) + i);
+	}
 
-		this->lower_l_bits_mask = (1ULL << l) - 1;
+	void finalize()
+	{
+		select_upper = PrefetchSelectHalf<>(&upper_bits, n + (u >> l) + 1);
+		selectz_upper = PrefetchSelectZeroHalf<>(&upper_bits, n + (u >> l) + 1);
 	}
 
 	uint64_t rank1(const size_t k) const
@@ -204,11 +254,32 @@ template <util::AllocType AT = util::AllocType::MALLOC> class InterleavedEliasFa
 		return res;
 	}
 
+	static const int PREFETCH_STAGES = 2;
+
+	// successor_value(i) split in PREFETCH_STAGES prefetch stages for interleaved lookups.
+	// Stage 0 prefetches the inventory of the zero select on the upper bits; stage 1 (issued
+	// after it) locates the bucket of i and prefetches its upper bits, its lower bits and the
+	// inventory of the select of its first element
+	void prefetch_successor(const uint64_t i, const int stage) const
+	{
+		if (n == 0 || i >= u) return;
+		const uint64_t i_shiftr_l = i >> l;
+
+		if (stage == 0){ selectz_upper.prefetch(i_shiftr_l); return; }
+
+		const uint64_t pos = selectz_upper.selectZero(i_shiftr_l);
+		const uint64_t rank = pos - i_shiftr_l;
+		__builtin_prefetch(&upper_bits + pos / 64);
+		__builtin_prefetch(&lower_bits + (rank * (l + w)) / 64);
+		if (rank < n) select_upper.prefetch(rank);
+	}
+
 	int64_t lower_bound(uint64_t key, uint8_t key_width) const
 	{
 		uint64_t r, s, val;
 
 		r = rank1(key);
+		if(r >= n) return -1; // key larger than all keys
 		s = select1_value(r, val) ^ key;
 
 		uint8_t mbits = (s == 0) ? key_width : (__builtin_clzll(s) & ~1) - (64 - u_width);
@@ -223,6 +294,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class InterleavedEliasFa
 		uint64_t r, s, val;
 
 		r = rank1(key) + offset;
+		if(r >= n) return -1;
 		s = select1_value(r, val) ^ key;
 
 		uint8_t mbits = (s == 0) ? key_width : (__builtin_clzll(s) & ~1) - (64 - u_width);
@@ -237,6 +309,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class InterleavedEliasFa
 		uint64_t r, r_, s, val;
 
 		r = rank1(key);    
+		if(r >= n) return std::make_tuple(-1,0,0);
 		s = select1_value(r, val);
 
 		if(s != key) return std::make_tuple(-1,0,0);
@@ -246,6 +319,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class InterleavedEliasFa
 		if(val+1 < u_width/2)
 		{
 			r++;
+			if(r >= n) return std::make_tuple(-1,0,0);
 			s = select1_value(r, val);
 
 			if(s != key) return std::make_tuple(-1,0,0);
@@ -67,7 +67,7 @@ template <util::AllocType AT = util::AllocType::MALLOC> class EliasFano : public
 	__inline static void set(util::Vector<uint64_t, AT> &bits, const uint64_t pos) { bits[pos / 64] |= 1ULL << pos % 64; }
 
 	__inline static uint64_t get_bits(const util::Vector<uint64_t, AT> &bits, const uint64_t start, const int width) {
-		const int start_word = start / 64;
+		const uint64_t start_word = start / 64;
 		const int start_bit = start % 64;
 		const int total_offset = start_bit + width;
 		const uint64_t result = bits[start_word] >> start_bit;
@@ -0,0 +1,319 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  external_sorter: sorts a stream of fixed-size records within a memory budget by
+ *  writing sorted runs to scratch files and merging them with a heap, at most
+ *  MAX_FAN_IN runs at a time
+ *  external_stack: a stack of fixed-size records within a memory budget, whose
+ *  bottom records are moved to a scratch file
+ */
+
+#ifndef EXTERNAL_SORT_HPP_
+#define EXTERNAL_SORT_HPP_
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+
+namespace stpd{
+
+// value_t must be a plain record that can be written to disk byte by byte
+template<class value_t, class compare_t = std::less<value_t>>
+class external_sorter
+{
+public:
+
+    // the records of a run (and the read buffers of the merge) take at most
+    // mem_bytes; n is the expected number of records, used to size the first run
+    external_sorter( const std::string& prefix_, size_t mem_bytes, size_t n = SIZE_MAX )
+        : prefix( prefix_ ), n_hint( n )
+    {
+        capacity = std::max<size_t>( 1, mem_bytes / sizeof(value_t) );
+    }
+
+    ~external_sorter() { clear(); }
+
+    void push( const value_t& x )
+    {
+        if( buf.capacity() == 0 ) buf.reserve( std::min( capacity, n_hint ) );
+        buf.push_back( x );
+        if( buf.size() == capacity ) flush();
+        ++count;
+    }
+
+    size_t size() const { return count; }
+
+    // end of the input: sort the last run and prepare the merge. While there are more
+    // than fan_in runs, groups of fan_in consecutive runs are merged into one, so that
+    // the read buffers keep at least MIN_BLOCK bytes and the open files are bounded
+    void sort()
+    {
+        if( runs.empty() ) { // everything fit in memory
+            std::sort( buf.begin(), buf.end(), cmp );
+            pos = 0;
+            return;
+        }
+        if( not buf.empty() ) flush();
+        std::vector<value_t>().swap( buf );
+
+        size_t fan_in = capacity * sizeof(value_t) / MIN_BLOCK;
+        if( fan_in > MAX_FAN_IN ) fan_in = MAX_FAN_IN;
+        if( fan_in < 2 ) fan_in = 2;
+        while( runs.size() > fan_in ) {
+            std::vector<std::string> merged;
+            for( size_t k = 0; k < runs.size(); k += fan_in ) {
+                size_t last = std::min( k + fan_in, runs.size() );
+                if( last - k == 1 ) { merged.push_back( runs[k] ); continue; }
+
+                // the output buffer takes the share of one more run
+                size_t block = std::max<size_t>( 1, capacity / ( last - k + 1 ) );
+                open( k, last, block );
+                merged.push_back( run_name() );
+                std::ofstream out( merged.back(), std::ios::binary );
+                if( not out ) {
+                    std::cerr << "Error: cannot write the scratch file " << merged.back() << std::endl;
+                    exit(1);
+                }
+                buf.reserve( block );
+                value_t x;
+                while( pop( x ) ) {
+                    buf.push_back( x );
+                    if( buf.size() == block ) write( out, merged.back() );
+                }
+                write( out, merged.back() );
+                out.close();
+                if( out.fail() ) {
+                    std::cerr << "Error: cannot write the scratch file " << merged.back() << std::endl;
+                    exit(1);
+                }
+                readers.clear();
+                for( size_t j = k; j < last; ++j ) std::remove( runs[j].c_str() );
+            }
+            runs.swap( merged );
+        }
+        std::vector<value_t>().swap( buf );
+
+        open( 0, runs.size(), std::max<size_t>( 1, capacity / runs.size() ) );
+    }
+
+    // next record in sorted order; false once all records have been read
+    bool next( value_t& x )
+    {
+        if( runs.empty() ) {
+            if( pos == buf.size() ) return false;
+            x = buf[pos++];
+            return true;
+        }
+        return pop( x );
+    }
+
+    // remove the run files and free the buffers
+    void clear()
+    {
+        while( not heap.empty() ) heap.pop();
+        readers.clear();
+        for( auto& f : runs ) std::remove( f.c_str() );
+        runs.clear();
+        std::vector<value_t>().swap( buf );
+        count = pos = 0;
+    }
+
+private:
+
+    static const size_t MAX_FAN_IN = 256; // runs merged at once
+    static const size_t MIN_BLOCK = 1 << 16; // bytes of a read buffer of the merge
+
+    struct reader
+    {
+        std::string name;
+        std::ifstream in;
+        std::vector<value_t> buf;
+        size_t pos = 0, len = 0;
+
+        bool fill()
+        {
+            in.read( (char*)buf.data(), buf.size() * sizeof(value_t) );
+            if( in.bad() or in.gcount() % sizeof(value_t) != 0 ) {
+                std::cerr << "Error: cannot read the scratch file " << name << std::endl;
+                exit(1);
+            }
+            len = in.gcount() / sizeof(value_t);
+            pos = 0;
+            return len > 0;
+        }
+    };
+
+    // heap order of the runs by their current record
+    struct run_greater
+    {
+        external_sorter* s;
+        bool operator()( size_t a, size_t b ) const
+        {
+            const value_t& x = s->readers[a].buf[ s->readers[a].pos ];
+            const value_t& y = s->readers[b].buf[ s->readers[b].pos ];
+            return s->cmp( y, x ) or ( not s->cmp( x, y ) and a > b );
+        }
+    };
+
+    std::string prefix;
+    size_t capacity, n_hint;
+    size_t count = 0, pos = 0, files = 0;
+    compare_t cmp;
+
+    std::vector<value_t> buf;
+    std::vector<std::string> runs;
+    std::vector<reader> readers;
+    std::priority_queue<size_t, std::vector<size_t>, run_greater> heap{ run_greater{ this } };
+
+    std::string run_name() { return prefix + "." + std::to_string( files++ ) + ".run"; }
+
+    // append the records of buf to out and clear it
+    void write( std::ofstream& out, const std::string& name )
+    {
+        out.write( (const char*)buf.data(), buf.size() * sizeof(value_t) );
+        if( not out ) {
+            std::cerr << "Error: cannot write the scratch file " << name << std::endl;
+            exit(1);
+        }
+        buf.clear();
+    }
+
+    void flush()
+    {
+        std::sort( buf.begin(), buf.end(), cmp );
+        runs.push_back( run_name() );
+        std::ofstream out( runs.back(), std::ios::binary );
+        if( not out ) {
+            std::cerr << "Error: cannot write the scratch file " << runs.back() << std::endl;
+            exit(1);
+        }
+        write( out, runs.back() );
+        out.close();
+        if( out.fail() ) {
+            std::cerr << "Error: cannot write the scratch file " << runs.back() << std::endl;
+            exit(1);
+        }
+    }
+
+    // read runs[first,last) with buffers of block records and start their merge
+    void open( size_t first, size_t last, size_t block )
+    {
+        readers.clear();
+        readers.resize( last - first );
+        for( size_t k = 0; k < readers.size(); ++k ) {
+            readers[k].name = runs[ first + k ];
+            readers[k].in.open( readers[k].name, std::ios::binary );
+            if( not readers[k].in.is_open() ) {
+                std::cerr << "Error: cannot open the scratch file " << readers[k].name << std::endl;
+                exit(1);
+            }
+            readers[k].buf.resize( block );
+            if( readers[k].fill() ) heap.push( k );
+        }
+    }
+
+    // next record of the merge of the open runs; false once they are all read
+    bool pop( value_t& x )
+    {
+        if( heap.empty() ) return false;
+
+        size_t k = heap.top(); heap.pop();
+        x = readers[k].buf[ readers[k].pos++ ];
+        if( readers[k].pos < readers[k].len or readers[k].fill() ) heap.push( k );
+        return true;
+    }
+};
+
+// value_t must be a plain record that can be written to disk byte by byte. Only the
+// top record can be modified: the others may be on disk
+template<class value_t>
+class external_stack
+{
+public:
+
+    // the records kept in memory take at most mem_bytes
+    external_stack( const std::string& file_, size_t mem_bytes ) : file( file_ )
+    {
+        capacity = std::max<size_t>( 2, mem_bytes / sizeof(value_t) );
+    }
+
+    ~external_stack() { clear(); }
+
+    bool empty() const { return buf.empty() and spilled == 0; }
+
+    size_t size() const { return buf.size() + spilled; }
+
+    value_t& back() { return buf.back(); }
+
+    // when the buffer is full, its bottom half is written after the records on disk
+    void push( const value_t& x )
+    {
+        if( buf.size() == capacity ) {
+            size_t k = capacity / 2;
+            if( not io.is_open() ) {
+                io.open( file, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc );
+                if( not io.is_open() ) {
+                    std::cerr << "Error: cannot write the scratch file " << file << std::endl;
+                    exit(1);
+                }
+            }
+            io.seekp( spilled * sizeof(value_t) );
+            io.write( (const char*)buf.data(), k * sizeof(value_t) );
+            if( not io ) {
+                std::cerr << "Error: cannot write the scratch file " << file << std::endl;
+                exit(1);
+            }
+            buf.erase( buf.begin(), buf.begin() + k );
+            spilled += k;
+        }
+        if( buf.capacity() == 0 ) buf.reserve( capacity );
+        buf.push_back( x );
+    }
+
+    // when the buffer is empty, the top records on disk refill half of it
+    void pop()
+    {
+        buf.pop_back();
+        if( buf.empty() and spilled > 0 ) {
+            size_t k = std::min( spilled, capacity / 2 );
+            spilled -= k;
+            buf.resize( k );
+            io.seekg( spilled * sizeof(value_t) );
+            io.read( (char*)buf.data(), k * sizeof(value_t) );
+            if( not io ) {
+                std::cerr << "Error: cannot read the scratch file " << file << std::endl;
+                exit(1);
+            }
+        }
+    }
+
+    // remove the scratch file and free the buffer
+    void clear()
+    {
+        if( io.is_open() ) {
+            io.close();
+            std::remove( file.c_str() );
+        }
+        std::vector<value_t>().swap( buf );
+        spilled = 0;
+    }
+
+private:
+
+    std::string file;
+    size_t capacity, spilled = 0; // records on disk
+    std::fstream io;
+    std::vector<value_t> buf; // top records
+};
+
+}
+
+#endif
@@ -0,0 +1,419 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  path_decomposition: ST path decomposition samples, prefix array, LCS array and
+ *  BWT of the reversed text, computed in memory from a text terminated by 0
+ */
+
+#ifndef PATH_DECOMPOSITION_HPP_
+#define PATH_DECOMPOSITION_HPP_
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <sdsl/construct.hpp>
+#include <libsais.h>
+#include <libsais64.h>
+#include <common.hpp>
+#include <build_profiler.hpp>
+#include <file_io.hpp>
+#include <parallel.hpp>
+
+#include "pfp.hpp"
+
+namespace stpd{
+
+// write the stream of pd.for_each_colex() in the stpd_small format: the samples (5 bytes
+// each) if has_samples and, if outPA_BWT, the PA, LCS (5 bytes) and reversed BWT files
+template<class pd_t>
+void store_colex( pd_t& pd, bool has_samples, const std::string output_file, bool outPA_BWT,
+                  const std::string output_file_PA, const std::string output_file_BWT,
+                  const std::string output_file_LCS )
+{
+    std::ofstream output, output_pa, output_lcs, output_bwt;
+    if(has_samples) output.open(output_file,std::ofstream::binary);
+    if(outPA_BWT)
+    {
+        output_pa.open(output_file_PA,std::ofstream::binary);
+        output_lcs.open(output_file_LCS,std::ofstream::binary);
+        output_bwt.open(output_file_BWT,std::ofstream::binary);
+    }
+
+    pd.for_each_colex( [&]( uint64_t x, char c, uint64_t y, bool sampled ) {
+        if(sampled)
+        {
+            uint64_t m = x-1;
+            output.write((char*)&m,5);
+        }
+        if(outPA_BWT)
+        {
+            output_pa.write((char*)&x,5);
+            output_lcs.write((char*)&y,5);
+            output_bwt.write((char*)&c,1);
+        }
+    });
+
+    if(has_samples) output.close();
+    if(outPA_BWT)
+    {
+        output_pa.close();
+        output_lcs.close();
+        output_bwt.close();
+    }
+}
+
+// write the stream of pd.for_each_colex() as the inputs of the stpd_index ingestion
+// constructor (int_bytes bytes per integer): the run-length reversed BWT in prefix.bwt.heads
+// and prefix.bwt.len, the (position, PA) pairs at the run boundaries in prefix.ssa and
+// prefix.esa, and the (sample, LCS) pairs in prefix.stpd
+template<class pd_t>
+void store_runs( pd_t& pd, const std::string prefix, uint64_t int_bytes )
+{
+    std::ofstream heads(prefix + ".bwt.heads",std::ofstream::binary);
+    int_file_writer lens(prefix + ".bwt.len",int_bytes), ssa(prefix + ".ssa",int_bytes),
+                    esa(prefix + ".esa",int_bytes), stpd(prefix + ".stpd",int_bytes);
+
+    uint64_t i = 0, start = 0, last = 0;
+    char head = 0;
+    pd.for_each_colex( [&]( uint64_t x, char c, uint64_t y, bool sampled ) {
+        if(sampled){ stpd.push(x-1); stpd.push(y); }
+        if(i == 0 or c != head)
+        {
+            if(i > 0)
+            {
+                heads.write(&head,1); lens.push(i-start);
+                esa.push(i-1); esa.push(last);
+            }
+            head = c; start = i;
+            ssa.push(i); ssa.push(x);
+        }
+        last = x; ++i;
+    });
+    if(i > 0)
+    {
+        heads.write(&head,1); lens.push(i-start);
+        esa.push(i-1); esa.push(last);
+    }
+
+    heads.close();
+    lens.close(); ssa.close(); esa.close(); stpd.close();
+}
+
+// suffix array of the n characters of text, which end with a unique 0, computed by
+// libsais on threads OpenMP threads
+inline void suffix_array( const uint8_t* text, size_t n, sdsl::int_vector<32>& sa, size_t threads )
+{
+    sa.resize( n );
+    if( libsais_omp( text, (int32_t*) sa.data(), n, 0, nullptr, threads ) != 0 ) {
+        std::cerr << "Error: suffix array construction failed" << std::endl;
+        exit(1);
+    }
+}
+
+inline void suffix_array( const uint8_t* text, size_t n, sdsl::int_vector<64>& sa, size_t threads )
+{
+    sa.resize( n );
+    if( libsais64_omp( text, (int64_t*) sa.data(), n, 0, nullptr, threads ) != 0 ) {
+        std::cerr << "Error: suffix array construction failed" << std::endl;
+        exit(1);
+    }
+}
+
+// Construction arrays are int_vector<32> for texts shorter than 2^31 characters
+// (32-bit libsais) and int_vector<64> otherwise (libsais64).
+//
+// The arrays are scheduled so that at most three N-word arrays are alive at once,
+// i.e. a peak of about 13 bytes per character with 32-bit arrays, including the text
+// and the sample bitvector (25 with 64-bit arrays), plus the stack of the colex
+// sampling (three words per leaf on it):
+//   1. PA (from a temporary T_rev) and SA
+//   2. PLCP = LCP in text order, with the Phi algorithm in place
+//   3. IPA, inverted in place in the PA buffer (colex only)
+//   4. sampling with one scan of SA, reading LCP[j] = PLCP[SA[j]]; the lex ranks
+//      in SA order are j, so no ISA and no stack are needed
+//   5. SA and PLCP are freed, PA is restored in place from IPA
+//   6. PLCS = LCS in PA text order, from PA and T read backwards (no T_rev)
+// The LCS array is never gathered: for_each_colex() reads LCS[i] = PLCS[PA[i]]
+template<class int_vector_t>
+class path_decomposition
+{
+public:
+
+    // T must end with a 0 terminator (see sdsl::append_zero_symbol)
+    path_decomposition( const sdsl::int_vector<8>& text ) : T( text ), N( text.size() ) { }
+
+    size_t threads = 1;
+    bool use_pfp = false; // stream PA order from a prefix-free parse of the reversed text
+    bool verbose = false; // report the planned and the achieved peak memory
+    size_t stack_peak = 0; // most leaves on the stack of the colex sampling
+    build_profiler* profiler = nullptr; // per-phase resource report (if not nullptr)
+
+    // Compute the ST colex/lex samples. If outPA_BWT, the LCS array is also computed
+    // for for_each_colex(). With use_pfp, PA is only computed for the colex ranks and
+    // the stream comes from the parse instead. Lex sampling replaces colex sampling
+    void compute( bool colexM, bool colexP, bool lexM, bool lexP, bool outPA_BWT )
+    {
+        bool colex = colexM or colexP, lex = lexM or lexP;
+        bool needPA = ( colex and not lex ) or ( not use_pfp and ( lex or outPA_BWT ) );
+
+        if( verbose ) {
+            double w = int_vector_t::fixed_int_width / 8, planned = 0; // bytes/char besides T
+            if( needPA ) planned = 1 + w; // T_rev and PA
+            if( colex or lex ) planned = std::max( planned, ( needPA ? 3 : 2 ) * w + 0.125 );
+            if( outPA_BWT and not use_pfp ) planned = std::max( planned, 2 * w + ( colex or lex ? 0.125 : 0 ) );
+            planned += 1;
+            std::cout << "[INFO] Path decomposition: planned peak " << planned << " bytes/char ("
+                      << (size_t)( planned * N ) / (1<<20) << " MiB)";
+            if( colex and not lex ) std::cout << " plus " << sizeof(leaf) << " bytes per leaf of the sampling stack";
+            std::cout << std::endl;
+        }
+
+        // PA if it is needed later, then SA; each suffix array uses all the threads
+        if( needPA ) {
+            build_profiler::phase ph( profiler, "PA" );
+            compute_PA();
+            ph.output( sdsl::size_in_bytes( PA ) );
+        }
+
+        if( colex or lex ) {
+            build_profiler::phase ph( profiler, "SA" );
+            suffix_array( (const uint8_t*) T.data(), N, SA, threads );
+            ph.output( sdsl::size_in_bytes( SA ) );
+        }
+
+        if( colex or lex ) {
+            {
+                build_profiler::phase ph( profiler, "LCP" );
+                phi_lcp( [this]( size_t i ) { return T[i]; }, SA, PLCP );
+                ph.output( sdsl::size_in_bytes( PLCP ) );
+            }
+
+            build_profiler::phase ph( profiler, "sampling" );
+            samples = sdsl::bit_vector( N, 0 );
+            if( lex ) {
+                sampling_lex( false, samples );
+                if( lexP ) sampling_lex( true, samples );
+            } else {
+                invert_in_place( PA ); IPA.swap( PA );
+                sampling( prefix_colex(), samples );
+                if( colexP ) sampling( prefix_colex_r(), samples );
+                if( use_pfp ) IPA.resize(0);
+                else { invert_in_place( IPA ); PA.swap( IPA ); }
+            }
+            SA.resize(0);
+            PLCP.resize(0);
+            ph.output( sdsl::size_in_bytes( samples ) );
+        }
+
+        // LCS is the LCP array of the reversed text, computed from the shared PA
+        if( outPA_BWT and not use_pfp ) {
+            build_profiler::phase ph( profiler, "LCS" );
+            phi_lcp( [this]( size_t i ) { return i < N-1 ? T[N-2-i] : 0; }, PA, PLCS );
+            ph.output( sdsl::size_in_bytes( PLCS ) );
+        }
+
+        if( verbose ) {
+            size_t peak = build_profiler::peak_rss();
+            std::cout << "[INFO] Path decomposition: achieved peak RSS " << (double)peak / N
+                      << " bytes/char (" << peak / (1<<20) << " MiB)";
+            if( colex and not lex ) std::cout << ", sampling stack " << stack_peak << " leaves ("
+                                              << stack_peak * sizeof(leaf) / (1<<20) << " MiB)";
+            std::cout << std::endl;
+        }
+    }
+
+    // call f(x, c, lcs, s) for every PA entry in order, where x = N-PA[i]-1 is the
+    // position following the prefix, c = T[x] the reversed BWT character, lcs = LCS[i]
+    // (0 if not computed) and s is true if x-1 is a sample; N-1 ($) is never a sample
+    template<class F>
+    void for_each_colex( F f )
+    {
+        auto g = [&]( uint64_t pa, char c, uint64_t lcs ) {
+            uint64_t x = N - pa - 1;
+            f( x, c, lcs, pa != N-1 and samples.size() > 0 and samples[x-1] );
+        };
+
+        if( use_pfp ) {
+            pfp parse( T );
+            parse.for_each( g );
+        } else {
+            for( size_t i = 0; i < PA.size(); ++i ) {
+                g( PA[i], (char)T[N-PA[i]-1], PLCS.size() > 0 ? (uint64_t)PLCS[PA[i]] : 0 );
+            }
+        }
+    }
+
+    // write the samples sorted by the colex rank of the prefix ending at them (if
+    // any were computed) and, if outPA_BWT, the PA, LCS and reversed BWT files
+    void store( const std::string output_file, bool outPA_BWT, const std::string output_file_PA,
+                const std::string output_file_BWT, const std::string output_file_LCS )
+    {
+        store_colex( *this, samples.size() > 0, output_file, outPA_BWT, output_file_PA, output_file_BWT, output_file_LCS );
+    }
+
+    // free all construction arrays
+    void clear()
+    {
+        SA.resize(0); PA.resize(0); IPA.resize(0); PLCP.resize(0); PLCS.resize(0);
+        samples = sdsl::bit_vector();
+    }
+
+private:
+
+    const sdsl::int_vector<8>& T;
+    size_t N;
+
+    int_vector_t SA;
+    int_vector_t PA;
+    int_vector_t IPA; // PA buffer, inverted in place
+    int_vector_t PLCP; // LCP[j] = PLCP[SA[j]]
+    int_vector_t PLCS; // LCS[i] = PLCS[PA[i]]
+
+    sdsl::bit_vector samples; // one bit per text position
+
+    // entries as wide as the construction arrays
+    typedef typename std::conditional< int_vector_t::fixed_int_width == 32, uint32_t, uint64_t >::type word_t;
+    struct leaf { word_t j, lcp, depth; }; // lcp: min LCP since the leaf
+
+    // Invert the permutation a in place by following its cycles; the entries already
+    // moved are marked with the top bit, which is free since N < 2^(width-1)
+    void invert_in_place( int_vector_t& a )
+    {
+        const uint64_t mark = 1ULL << ( int_vector_t::fixed_int_width - 1 );
+        for( size_t i = 0; i < a.size(); ++i ) {
+            if( a[i] & mark ) continue;
+            uint64_t prev = i, cur = a[i];
+            while( cur != i ) {
+                uint64_t next = a[cur];
+                a[cur] = prev | mark;
+                prev = cur;
+                cur = next;
+            }
+            a[i] = prev | mark;
+        }
+        parallel_for( a.size(), threads, [&]( size_t b, size_t e ) {
+            for( size_t i = b; i < e; ++i ) { a[i] = a[i] & ~mark; }
+        });
+    }
+
+    // PLCP construction with the Phi algorithm (Karkkainen, Manzini and Puglisi):
+    // PLCP[i] = LCP[ISA[i]] is computed in text order, comparing suffix i with its
+    // predecessor Phi[i] in SA order, so that the text is scanned sequentially and
+    // no ISA is needed. PLCP overwrites Phi in place; every thread restarts the
+    // computation at the beginning of its chunk of text positions. text(i) returns
+    // the i-th character, so that the reversed text needs no copy
+    template<class text_t>
+    void phi_lcp( text_t text, const int_vector_t& sa, int_vector_t& plcp )
+    {
+        size_t n = sa.size();
+        plcp.resize( n );
+        plcp[ sa[0] ] = sa[0];
+        parallel_for( n-1, threads, [&]( size_t b, size_t e ) {
+            for( size_t i = b+1; i <= e; ++i ) { plcp[ sa[i] ] = sa[i-1]; }
+        });
+
+        parallel_for( n, threads, [&]( size_t b, size_t e ) {
+            size_t m = 0;
+            for( size_t i = b; i < e; ++i ) {
+                if( i == sa[0] ) { plcp[i] = 0; m = 0; continue; }
+                size_t j = plcp[i];
+                while( m < n ) {
+                    if( text(i+m) != text(j+m) ) break;
+                    ++m;
+                }
+                plcp[i] = m;
+                if( m > 0 ) --m;
+            }
+        });
+    }
+
+    // compute the prefix array, i.e. the suffix array of the reversed text
+    void compute_PA()
+    {
+        size_t n = T.size();
+        sdsl::int_vector<8> T_rev( n );
+
+        assert( T[n-1] == '\0' );
+        T_rev[n-1] = '\0';
+        for( size_t i = 0; i < n-1; ++i ) {
+            T_rev[ n-2 - i ] = T[ i ];
+        }
+
+        suffix_array( (const uint8_t*) T_rev.data(), n, PA, threads );
+    }
+
+    // rank of the leaf j of the suffix tree (suffix p = SA[j]) used by sampling();
+    // the colex ranks are read from IPA (the prefix ending at p < N-1 has colex rank
+    // IPA[N-2-p]) instead of being copied into a new N-sized array
+    auto prefix_colex()
+    {
+        return [this]( size_t, size_t p ) -> uint64_t { return p == N-1 ? 0 : IPA[N-2-p]; };
+    }
+
+    auto prefix_colex_r()
+    {
+        return [this]( size_t, size_t p ) -> uint64_t { return p == N-1 ? N-1 : N-1-IPA[N-2-p]; };
+    }
+
+    // The leaves of the suffix tree are visited in rank order; each leaf marks its
+    // unmarked ancestors and samples SA[j] + depth of its deepest marked ancestor.
+    // That ancestor is the deepest LCA between the leaf and a leaf of smaller rank,
+    // so its depth is the largest LCP between the suffix and the nearest suffix of
+    // smaller rank on its left or right in SA order. Both are found in one scan of
+    // SA with a stack of leaves of increasing rank: the left depth is known when a
+    // leaf is pushed, the right one when it is popped by the next smaller rank (0 if
+    // it is never popped). samples are marked in S, which has one bit per text position
+    // A leaf on the stack keeps its SA index, from which its suffix and its rank are
+    // recomputed, so it takes three words of the construction arrays
+    template<class rank_t>
+    void sampling( rank_t rank, sdsl::bit_vector& S )
+    {
+        std::vector<leaf> stk;
+        uint64_t top = 0; // rank of the leaf on top of the stack
+
+        for( size_t j = 0; j < N; ++j ) {
+            uint64_t p = SA[j], r = rank( j, p );
+            if( !stk.empty() ) {
+                stk.back().lcp = std::min<word_t>( stk.back().lcp, PLCP[p] );
+                while( !stk.empty() && top > r ) {
+                    leaf l = stk.back();
+                    stk.pop_back();
+                    S[ SA[l.j] + std::max( l.depth, l.lcp ) ] = 1;
+                    if( !stk.empty() ) {
+                        stk.back().lcp = std::min( stk.back().lcp, l.lcp );
+                        top = rank( stk.back().j, SA[stk.back().j] );
+                    }
+                }
+            }
+            word_t d = stk.empty() ? 0 : stk.back().lcp;
+            stk.push_back( leaf{ (word_t)j, std::numeric_limits<word_t>::max(), d } );
+            top = r;
+            stack_peak = std::max( stack_peak, stk.size() );
+        }
+        for( const leaf& l : stk ) S[ SA[l.j] + l.depth ] = 1;
+    }
+
+    // sampling() for the lex ranks, which are monotone in SA order. With increasing
+    // ranks (lex-) no leaf is popped and leaf j samples SA[j] + LCP[j]; with decreasing
+    // ranks (lex+) leaf j is popped by leaf j+1 from an otherwise empty stack and
+    // samples SA[j] + LCP[j+1], or SA[j] for the last leaf
+    void sampling_lex( bool reversed, sdsl::bit_vector& S )
+    {
+        for( size_t j = 0; j < N; ++j ) {
+            size_t k = reversed ? j+1 : j;
+            S[ SA[j] + ( k > 0 and k < N ? PLCP[ SA[k] ] : 0 ) ] = 1;
+        }
+    }
+};
+
+}
+
+#endif
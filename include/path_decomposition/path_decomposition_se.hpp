@@ -0,0 +1,325 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  path_decomposition_se: semi-external version of path_decomposition. The text is
+ *  memory mapped, the SA, LCP, PA and LCS arrays are built on disk with sdsl's
+ *  semi-external SA-IS and PHI algorithms, and the rank joins of the sampling are
+ *  done with external sorting, so that no N-word array is ever kept in memory
+ */
+
+#ifndef PATH_DECOMPOSITION_SE_HPP_
+#define PATH_DECOMPOSITION_SE_HPP_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <unistd.h>
+#include <sdsl/construct.hpp>
+#include <common.hpp>
+#include <build_profiler.hpp>
+#include <file_io.hpp>
+
+#include "external_sort.hpp"
+#include "path_decomposition.hpp"
+
+namespace stpd{
+
+class path_decomposition_se
+{
+public:
+
+    // text_file is the raw input text (a 0 terminator is appended implicitly);
+    // mem_limit is the RAM budget in bytes for the sort runs and the disk buffers,
+    // scratch_dir holds the temporary arrays (about 30N bytes at the peak)
+    path_decomposition_se( const std::string& text_file, size_t mem_limit, const std::string& scratch_dir )
+        : text_map( text_file ), text_data( text_map.data() ), N( text_map.size() + 1 )
+    {
+        if( N == 1 ) {
+            std::cerr << "Error: the input text " << text_file << " is empty" << std::endl;
+            exit(1);
+        }
+
+        sort_bytes = std::max<size_t>( mem_limit / 4, 1<<20 );
+        buffer_bytes = std::min<size_t>( std::max<size_t>( mem_limit / 32, 1<<16 ), 1<<26 );
+
+        std::string id = "stpd_" + std::to_string( getpid() );
+        cfg = sdsl::cache_config( true, scratch_dir, id );
+        cfg_rev = sdsl::cache_config( true, scratch_dir, id + "_rev" );
+        prefix = scratch_dir + "/" + id;
+    }
+
+    ~path_decomposition_se() { clear(); }
+
+    bool verbose = false; // report the memory budget and the achieved peak
+    size_t stack_peak = 0; // most leaves on the stack of the sampling
+    build_profiler* profiler = nullptr; // per-phase resource report (if not nullptr)
+
+    // Same outputs as path_decomposition::compute(). PA is always computed since the
+    // samples are written in PA order; the samples are kept on disk as the sorted list
+    // of the colex ranks of the prefixes ending at them
+    void compute( bool colexM, bool colexP, bool lexM, bool lexP, bool outPA_BWT )
+    {
+        bool colex = colexM or colexP, lex = lexM or lexP;
+
+        if( verbose ) {
+            std::cout << "[INFO] Semi-external path decomposition: sort runs of " << sort_bytes / (1<<20)
+                      << " MiB, disk buffers of " << buffer_bytes / (1<<10) << " KiB, scratch space of about "
+                      << 30 * N / (1<<20) << " MiB" << std::endl;
+        }
+
+        write_texts( colex or lex );
+
+        // the phase outputs are the disk arrays
+        auto phase = [&]( const std::string& name, sdsl::cache_config& c, const std::string& key, std::function<void()> f ) {
+            build_profiler::phase ph( profiler, name );
+            f();
+            ph.output( file_size( sdsl::cache_file_name( key, c ) ) );
+        };
+
+        sdsl::byte_sa_algo_type algo = sdsl::construct_config::byte_algo_sa;
+        sdsl::construct_config::byte_algo_sa = sdsl::SE_SAIS;
+        if( colex or lex ) {
+            phase( "SA", cfg, sdsl::conf::KEY_SA, [&](){ sdsl::construct_sa<8>( cfg ); } );
+            phase( "LCP", cfg, sdsl::conf::KEY_LCP, [&](){ sdsl::construct_lcp_semi_extern_PHI( cfg ); } );
+            remove_cache_file( sdsl::conf::KEY_TEXT, cfg );
+        }
+        phase( "PA", cfg_rev, sdsl::conf::KEY_SA, [&](){ sdsl::construct_sa<8>( cfg_rev ); } );
+        if( outPA_BWT ) {
+            phase( "LCS", cfg_rev, sdsl::conf::KEY_LCP, [&](){ sdsl::construct_lcp_semi_extern_PHI( cfg_rev ); } );
+            has_lcs = true;
+        }
+        remove_cache_file( sdsl::conf::KEY_TEXT, cfg_rev );
+        sdsl::construct_config::byte_algo_sa = algo;
+
+        if( colex or lex ) {
+            build_profiler::phase ph( profiler, "sampling" );
+            colex_ranks( colex and not lex );
+
+            // lex sampling replaces the colex samples
+            external_sorter<uint64_t> S( prefix + ".samples", sort_bytes, N );
+            if( lex ) {
+                sampling( [&]( size_t j ) -> uint64_t { return j; }, S );
+                if( lexP ) sampling( [&]( size_t j ) -> uint64_t { return N-1-j; }, S );
+            } else {
+                sdsl::int_vector_buffer<> RankSA( prefix + ".ranksa", std::ios::in, buffer_bytes );
+                sampling( [&]( size_t j ) -> uint64_t { return RankSA[j]; }, S );
+                if( colexP ) sampling( [&]( size_t j ) -> uint64_t { return N-1-RankSA[j]; }, S );
+                RankSA.close( true );
+            }
+            sort_samples( S );
+
+            remove_cache_file( sdsl::conf::KEY_SA, cfg );
+            remove_cache_file( sdsl::conf::KEY_LCP, cfg );
+            std::remove( ( prefix + ".cr" ).c_str() );
+            ph.output( file_size( prefix + ".sampled" ) );
+        }
+
+        if( verbose ) {
+            size_t peak = build_profiler::peak_rss();
+            std::cout << "[INFO] Semi-external path decomposition: achieved peak RSS " << peak / (1<<20)
+                      << " MiB (" << (double)peak / N << " bytes/char)";
+            if( colex or lex ) std::cout << ", sampling stack " << stack_peak << " leaves";
+            std::cout << std::endl;
+        }
+    }
+
+    // same stream as path_decomposition::for_each_colex(), read from the disk arrays
+    template<class F>
+    void for_each_colex( F f )
+    {
+        sdsl::int_vector_buffer<> PA( sdsl::cache_file_name( sdsl::conf::KEY_SA, cfg_rev ), std::ios::in, buffer_bytes );
+        std::unique_ptr< sdsl::int_vector_buffer<> > LCS, samples;
+        if( has_lcs )
+            LCS.reset( new sdsl::int_vector_buffer<>( sdsl::cache_file_name( sdsl::conf::KEY_LCP, cfg_rev ), std::ios::in, buffer_bytes ) );
+        if( has_samples )
+            samples.reset( new sdsl::int_vector_buffer<>( prefix + ".sampled", std::ios::in, buffer_bytes ) );
+
+        size_t k = 0; // next sampled colex rank
+        for( size_t i = 0; i < N; ++i ) {
+            uint64_t x = N - PA[i] - 1;
+            bool sampled = has_samples and k < samples->size() and (*samples)[k] == i;
+            if( sampled ) ++k;
+            f( x, (char)text( x ), has_lcs ? (uint64_t)(*LCS)[i] : 0, sampled );
+        }
+    }
+
+    void store( const std::string output_file, bool outPA_BWT, const std::string output_file_PA,
+                const std::string output_file_BWT, const std::string output_file_LCS )
+    {
+        store_colex( *this, has_samples, output_file, outPA_BWT, output_file_PA, output_file_BWT, output_file_LCS );
+    }
+
+    // remove all scratch files
+    void clear()
+    {
+        sdsl::util::delete_all_files( cfg.file_map );
+        sdsl::util::delete_all_files( cfg_rev.file_map );
+        for( const char* ext : { ".cr", ".ranksa", ".sampled" } )
+            std::remove( ( prefix + ext ).c_str() );
+        has_samples = has_lcs = false;
+    }
+
+private:
+
+    mapped_file text_map; // input text
+    const uint8_t* text_data;
+    size_t N; // text length including the 0 terminator
+
+    size_t sort_bytes, buffer_bytes;
+    sdsl::cache_config cfg, cfg_rev; // T (SA, LCP) and T_rev (PA, LCS)
+    std::string prefix;
+
+    bool has_samples = false, has_lcs = false;
+
+    uint8_t text( size_t i ) const { return i < N-1 ? text_data[i] : 0; }
+
+    uint8_t width() const { return sdsl::bits::hi( N ) + 1; }
+
+    void remove_cache_file( const std::string& key, sdsl::cache_config& config )
+    {
+        std::remove( sdsl::cache_file_name( key, config ).c_str() );
+        config.file_map.erase( key );
+    }
+
+    static size_t file_size( const std::string& path )
+    {
+        struct stat st;
+        return stat( path.c_str(), &st ) == 0 ? st.st_size : 0;
+    }
+
+    // write T and T_rev, both 0-terminated, as sdsl files for the disk constructions
+    void write_texts( bool forward )
+    {
+        text_map.advise_sequential( true );
+        for( size_t i = 0; i < N-1; ++i ) {
+            if( text_data[i] == 0 ) {
+                std::cerr << "Error: the input text contains the 0 symbol" << std::endl;
+                exit(1);
+            }
+        }
+
+        if( forward ) {
+            sdsl::int_vector_buffer<8> out( sdsl::cache_file_name( sdsl::conf::KEY_TEXT, cfg ), std::ios::out, buffer_bytes );
+            for( size_t i = 0; i < N; ++i ) out.push_back( text( i ) );
+            sdsl::register_cache_file( sdsl::conf::KEY_TEXT, cfg );
+        }
+        {
+            sdsl::int_vector_buffer<8> out( sdsl::cache_file_name( sdsl::conf::KEY_TEXT, cfg_rev ), std::ios::out, buffer_bytes );
+            for( size_t i = N-1; i-- > 0; ) out.push_back( text_data[i] );
+            out.push_back( 0 );
+            sdsl::register_cache_file( sdsl::conf::KEY_TEXT, cfg_rev );
+        }
+        text_map.advise_sequential( false );
+    }
+
+    // Write CR[q], the colex rank of the prefix ending at q (CR[N-1] = 0), by sorting
+    // the pairs (N-2-PA[i], i). If rank_sa, also write RankSA[j] = CR[SA[j]] by joining
+    // CR with the pairs (SA[j], j) sorted by text position and sorting the result by j
+    void colex_ranks( bool rank_sa )
+    {
+        typedef std::pair<uint64_t,uint64_t> pair_t;
+        {
+            external_sorter<pair_t> B( prefix + ".pa", sort_bytes, N );
+            {
+                sdsl::int_vector_buffer<> PA( sdsl::cache_file_name( sdsl::conf::KEY_SA, cfg_rev ), std::ios::in, buffer_bytes );
+                for( size_t i = 0; i < N; ++i ) {
+                    uint64_t p = PA[i];
+                    if( p != N-1 ) B.push( pair_t( N-2-p, i ) );
+                }
+            }
+            B.sort();
+
+            sdsl::int_vector_buffer<> CR( prefix + ".cr", std::ios::out, buffer_bytes, width() );
+            pair_t e;
+            while( B.next( e ) ) CR.push_back( e.second );
+            CR.push_back( 0 );
+        }
+
+        if( not rank_sa ) return;
+
+        external_sorter<pair_t> A( prefix + ".sa", sort_bytes, N );
+        {
+            sdsl::int_vector_buffer<> SA( sdsl::cache_file_name( sdsl::conf::KEY_SA, cfg ), std::ios::in, buffer_bytes );
+            for( size_t j = 0; j < N; ++j ) A.push( pair_t( SA[j], j ) );
+        }
+        A.sort();
+
+        external_sorter<pair_t> C( prefix + ".rank", sort_bytes, N );
+        {
+            sdsl::int_vector_buffer<> CR( prefix + ".cr", std::ios::in, buffer_bytes );
+            pair_t e;
+            while( A.next( e ) ) C.push( pair_t( e.second, CR[e.first] ) );
+        }
+        A.clear();
+        C.sort();
+
+        sdsl::int_vector_buffer<> RankSA( prefix + ".ranksa", std::ios::out, buffer_bytes, width() );
+        pair_t e;
+        while( C.next( e ) ) RankSA.push_back( e.second );
+    }
+
+    // path_decomposition::sampling() over the disk SA and LCP arrays, which are
+    // both read sequentially. The sampled text positions are pushed to S. The stack
+    // can reach N leaves (e.g. with the increasing ranks of lex sampling), so its
+    // bottom is moved to disk beyond buffer_bytes
+    template<class rank_t>
+    void sampling( rank_t rank, external_sorter<uint64_t>& S )
+    {
+        sdsl::int_vector_buffer<> SA( sdsl::cache_file_name( sdsl::conf::KEY_SA, cfg ), std::ios::in, buffer_bytes );
+        sdsl::int_vector_buffer<> LCP( sdsl::cache_file_name( sdsl::conf::KEY_LCP, cfg ), std::ios::in, buffer_bytes );
+
+        struct leaf { uint64_t rank, lcp, pos, depth; }; // lcp: min LCP since the leaf
+        external_stack<leaf> stk( prefix + ".stack", buffer_bytes );
+
+        for( size_t j = 0; j < N; ++j ) {
+            uint64_t p = SA[j], r = rank( j );
+            if( !stk.empty() ) {
+                stk.back().lcp = std::min( stk.back().lcp, (uint64_t)LCP[j] );
+                while( !stk.empty() && stk.back().rank > r ) {
+                    leaf l = stk.back();
+                    stk.pop();
+                    S.push( l.pos + std::max( l.depth, l.lcp ) );
+                    if( !stk.empty() ) stk.back().lcp = std::min( stk.back().lcp, l.lcp );
+                }
+            }
+            uint64_t d = stk.empty() ? 0 : stk.back().lcp;
+            stk.push( leaf{ r, UINT64_MAX, p, d } );
+            stack_peak = std::max<size_t>( stack_peak, stk.size() );
+        }
+        for( ; !stk.empty(); stk.pop() ) S.push( stk.back().pos + stk.back().depth );
+    }
+
+    // replace every sampled position m < N-1 (without duplicates) by CR[m] and store
+    // the sorted colex ranks
+    void sort_samples( external_sorter<uint64_t>& S )
+    {
+        S.sort();
+
+        external_sorter<uint64_t> R( prefix + ".colex", sort_bytes, N );
+        {
+            sdsl::int_vector_buffer<> CR( prefix + ".cr", std::ios::in, buffer_bytes );
+            uint64_t m, prev = UINT64_MAX;
+            while( S.next( m ) ) {
+                if( m != prev and m != N-1 ) R.push( CR[m] );
+                prev = m;
+            }
+        }
+        S.clear();
+        R.sort();
+
+        sdsl::int_vector_buffer<> out( prefix + ".sampled", std::ios::out, buffer_bytes, width() );
+        uint64_t r;
+        while( R.next( r ) ) out.push_back( r );
+        has_samples = true;
+    }
+};
+
+}
+
+#endif
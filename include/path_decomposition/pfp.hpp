@@ -0,0 +1,244 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  pfp: prefix-free parsing (Boucher et al., "Prefix-free parsing for building big BWTs")
+ *  of the reversed text. It streams the prefix array, the LCS array and the BWT of the
+ *  reversed text in PA order using working memory proportional to the parse and the
+ *  dictionary, instead of the N-word PA/IPA/LCS arrays.
+ */
+
+#ifndef PFP_HPP_
+#define PFP_HPP_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <tuple>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <sdsl/int_vector.hpp>
+#include <sdsl/rmq_support.hpp>
+
+// integer alphabet SA construction of gsacak (https://github.com/felipelouza/gsa-is);
+// gsacak.h is not included since it defines the max and DEBUG macros. The SA entries
+// are 64-bit when compiled with M64 (gsacak64 target), 32-bit otherwise (gsacak)
+#if defined(M64) && M64
+typedef uint64_t gsacak_uint_t;
+#else
+typedef uint32_t gsacak_uint_t;
+#endif
+extern "C" int sacak_int( uint32_t *s, gsacak_uint_t *SA, gsacak_uint_t n, gsacak_uint_t k );
+
+namespace stpd{
+
+// Z = T_rev[0,N-1) 0^w is split into phrases that start and end with a trigger string
+// (a w-long window whose Karp-Rabin fingerprint is 0 mod p) and overlap by w characters.
+// Every suffix of T_rev is alpha Z[start_{k+1}+w..], where alpha is a suffix of phrase k
+// longer than w. The alphas are prefix-free, so suffixes are sorted first by alpha and
+// then, within a group of equal alphas, by the rank of the parse suffix P[k+1..].
+class pfp
+{
+public:
+
+    pfp( const sdsl::int_vector<8>& text, size_t w_ = 10, size_t p_ = 100 ) : T( text ), w( w_ ), p( p_ )
+    {
+        n = T.size();
+        parse();
+        sort_parse();
+    }
+
+    // call f(PA[i], rBWT[i], LCS[i]) for i = 0, ..., N-1
+    template<class F>
+    void for_each( F f )
+    {
+        // the suffix 0 of T_rev comes first
+        f( n-1, (char)T[0], 0 );
+
+        // alphas (phrase, offset) sorted lexicographically
+        std::vector< std::pair<uint32_t,uint32_t> > alpha;
+        for( size_t d = 1; d <= D.size(); ++d ) {
+            for( size_t o = 0; o + w < D[d-1].size(); ++o ) {
+                // alphas starting in 0^w are not suffixes of T_rev
+                if( D[d-1][o] != 0 ) alpha.push_back( std::make_pair( d, o ) );
+            }
+        }
+        std::sort( alpha.begin(), alpha.end(), [&]( const std::pair<uint32_t,uint32_t>& a,
+                                                    const std::pair<uint32_t,uint32_t>& b ) {
+            int c = D[a.first-1].compare( a.second, std::string::npos, D[b.first-1], b.second, std::string::npos );
+            return c < 0 or ( c == 0 and a.first < b.first );
+        });
+
+        // min-heap of (rank of P[k+1..], alpha index, position in occ)
+        typedef std::tuple<uint64_t,size_t,size_t> entry;
+        std::priority_queue< entry, std::vector<entry>, std::greater<entry> > heap;
+
+        size_t prev = 0; // previous group
+        for( size_t g = 0; g < alpha.size(); ) {
+            const std::string& a = D[alpha[g].first-1];
+            size_t off = alpha[g].second, len = a.size()-off;
+
+            size_t e = g+1;
+            while( e < alpha.size() and a.compare( off, std::string::npos, D[alpha[e].first-1], alpha[e].second,
+                                                   std::string::npos ) == 0 ) { ++e; }
+
+            // distinct alphas are not prefixes of each other
+            uint64_t lcs = g == 0 ? 0 : lcp_str( D[alpha[prev].first-1], alpha[prev].second, a, off );
+
+            for( size_t t = g; t < e; ++t ) {
+                uint32_t d = alpha[t].first;
+                if( occ_begin[d] < occ_begin[d+1] ) heap.push( std::make_tuple( occ[occ_begin[d]], t, occ_begin[d] ) );
+            }
+
+            bool first = true;
+            uint64_t prev_r = 0;
+            while( !heap.empty() ) {
+                uint64_t r; size_t t, i;
+                std::tie( r, t, i ) = heap.top(); heap.pop();
+
+                uint32_t d = alpha[t].first, o = alpha[t].second;
+                if( i+1 < occ_begin[d+1] ) heap.push( std::make_tuple( occ[i+1], t, i+1 ) );
+
+                uint64_t k = SA[r]-1;
+                char c;
+                if( o > 0 ) c = D[d-1][o-1];
+                else if( k > 0 ) { const std::string& q = D[P[k-1]-1]; c = q[q.size()-w-1]; }
+                else c = 0;
+
+                // equal alphas are followed by the same trigger string and the parse suffixes
+                if( !first ) lcs = len - w + LCP[ rmq( prev_r+1, r ) ];
+
+                f( start[k] + o, c, lcs );
+
+                first = false;
+                prev_r = r;
+            }
+
+            prev = g;
+            g = e;
+        }
+    }
+
+private:
+
+    const sdsl::int_vector<8>& T;
+    size_t n, w, p;
+
+    std::vector<std::string> D;   // dictionary, sorted; phrase d is D[d-1]
+    std::vector<uint32_t> P;      // parse, terminated by 0
+    std::vector<uint64_t> start;  // start[k]: position of phrase k in Z; start[|P|-1] = N-1
+    std::vector<gsacak_uint_t> SA; // suffix array of P
+    sdsl::int_vector<64> LCP;     // LCP of consecutive parse suffixes in characters
+    sdsl::rmq_succinct_sct<> rmq;
+    std::vector<uint64_t> occ_begin; // occ[occ_begin[d], occ_begin[d+1]): ranks r with P[SA[r]-1] = d
+    std::vector<gsacak_uint_t> occ;
+
+    uint8_t zchar( size_t i ) const { return i < n-1 ? T[n-2-i] : 0; }
+
+    static uint64_t lcp_str( const std::string& a, size_t i, const std::string& b, size_t j )
+    {
+        uint64_t l = 0;
+        while( i+l < a.size() and j+l < b.size() and a[i+l] == b[j+l] ) ++l;
+        return l;
+    }
+
+    void parse()
+    {
+        const uint64_t prime = 1999999973ULL, base = 256;
+        uint64_t pw = 1; // base^(w-1) mod prime
+        for( size_t i = 1; i < w; ++i ) pw = pw*base % prime;
+
+        std::unordered_map<std::string,uint32_t> ids;
+        std::string phrase;
+        size_t m = n-1+w, s = 0;
+        uint64_t h = 0; // fingerprint of Z[i-w+1,i]
+        for( size_t i = 0; i < m; ++i ) {
+            uint8_t c = zchar( i );
+            phrase.push_back( c );
+            if( i >= w ) h = ( h + prime - zchar( i-w )*pw % prime ) % prime;
+            h = ( h*base + c ) % prime;
+
+            // the last window 0^w always is a trigger string
+            if( i+1 >= w and ( i == m-1 or h % p == 0 ) and i+1-w > s ) {
+                auto it = ids.emplace( phrase, (uint32_t)ids.size() ).first;
+                P.push_back( it->second );
+                start.push_back( s );
+                phrase.erase( 0, phrase.size()-w );
+                s = i+1-w;
+            }
+        }
+        start.push_back( n-1 );
+
+        // rename phrases by lexicographic rank, 0 is the terminator of P
+        D.resize( ids.size() );
+        for( auto& x : ids ) D[x.second] = x.first;
+        ids.clear();
+        std::vector<uint32_t> rank( D.size() );
+        for( size_t d = 0; d < D.size(); ++d ) rank[d] = d;
+        std::sort( rank.begin(), rank.end(), [&]( uint32_t a, uint32_t b ) { return D[a] < D[b]; } );
+        std::vector<std::string> sorted( D.size() );
+        std::vector<uint32_t> name( D.size() );
+        for( size_t d = 0; d < D.size(); ++d ) { name[rank[d]] = d+1; sorted[d].swap( D[rank[d]] ); }
+        D.swap( sorted );
+        for( auto& x : P ) x = name[x];
+        P.push_back( 0 );
+    }
+
+    void sort_parse()
+    {
+        size_t np = P.size();
+        if( np > UINT32_MAX ) { std::cerr << "Error: the parse has too many phrases" << std::endl; exit(1); }
+
+        SA.resize( np );
+        sacak_int( P.data(), SA.data(), np, D.size()+1 );
+
+        { // LCP of the parse in phrases (Kasai et al.), then in characters
+            std::vector<gsacak_uint_t> ISA( np );
+            for( size_t r = 0; r < np; ++r ) ISA[SA[r]] = r;
+
+            LCP.resize( np );
+            LCP[0] = 0;
+            size_t h = 0;
+            for( size_t a = 0; a < np; ++a ) {
+                size_t r = ISA[a];
+                if( r == 0 ) { h = 0; continue; }
+                size_t b = SA[r-1];
+                while( P[a+h] == P[b+h] ) ++h;
+                LCP[r] = h;
+                if( h > 0 ) --h;
+            }
+
+            // the first phrase may not start with a trigger string, so the rank of
+            // P[0..] is meaningless: compare its successor with its predecessor instead
+            // and never return it as a minimum
+            size_t r0 = ISA[0];
+            for( size_t r = 1; r < np; ++r ) {
+                if( r == r0 ) continue;
+                size_t a = SA[r], b = SA[r-1], h = LCP[r];
+                if( r-1 == r0 ) { b = SA[r-2]; h = std::min( h, (size_t)LCP[r0] ); }
+
+                uint64_t l = start[a+h] - start[a];
+                if( P[a+h] != 0 and P[b+h] != 0 ) l += lcp_str( D[P[a+h]-1], 0, D[P[b+h]-1], 0 );
+                LCP[r] = l;
+            }
+            LCP[r0] = UINT64_MAX;
+        }
+        rmq = sdsl::rmq_succinct_sct<>( &LCP );
+
+        // ranks of the parse suffixes grouped by the preceding phrase
+        occ_begin.assign( D.size()+2, 0 );
+        for( size_t r = 0; r < np; ++r ) { if( SA[r] > 0 ) ++occ_begin[ P[SA[r]-1]+1 ]; }
+        for( size_t d = 1; d < occ_begin.size(); ++d ) occ_begin[d] += occ_begin[d-1];
+        occ.resize( np-1 );
+        std::vector<uint64_t> pos( occ_begin.begin(), occ_begin.end()-1 );
+        for( size_t r = 0; r < np; ++r ) { if( SA[r] > 0 ) occ[ pos[ P[SA[r]-1] ]++ ] = r; }
+    }
+};
+
+}
+
+#endif
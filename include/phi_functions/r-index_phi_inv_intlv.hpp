@@ -3,6 +3,7 @@
 
 #include <elias_fano_intlv.hpp>
 #include <common.hpp>
+#include <parallel.hpp>
 
 namespace stpd{
 
@@ -12,6 +13,46 @@ public:
 	
 	r_index_phi_inv_intlv(){} // empty constructor
 
+	// one-pass construction: push the (PA entry, reversed BWT character) pairs in PA
+	// order, e.g. while streaming the path decomposition, then pass it to build()
+	class builder
+	{
+	public:
+
+		void push(usafe_t curr_sa, char curr)
+		{
+			if(n++ == 0){ return; } // skip first entry for $
+			// associate each end-of-run sample with the next beginning-of-run sample
+			if(n > 2 and curr != prev)
+				last_first.push_back(std::make_pair(prev_sa-1,curr_sa-1));
+
+			prev = curr;
+			prev_sa = curr_sa;
+		}
+
+		// same as pushing the len entries of a run of curr, whose first and last
+		// entries are first_sa and last_sa: the entries inside a run add no samples
+		void push_run(char curr, usafe_t len, usafe_t first_sa, usafe_t last_sa)
+		{
+			if(len == 0){ return; }
+			push(first_sa,curr);
+			if(len > 2)
+			{
+				push(first_sa,curr); // only sets the previous character
+				n += len-3;
+			}
+			if(len > 1){ push(last_sa,curr); }
+		}
+
+	private:
+
+		friend class r_index_phi_inv_intlv;
+
+		std::vector<std::pair<usafe_t,usafe_t>> last_first;
+		usafe_t n = 0, prev_sa = 0; // BWT length and previous SA entry
+		char prev = 0; // previous BWT character
+	};
+
 	void build(const std::string bwt_filename, const std::string sa_filename, bool_t verbose = true)
 	{
 		std::ifstream bwt(bwt_filename,std::ifstream::binary);
@@ -19,49 +60,33 @@ public:
 		std::ifstream sa(sa_filename,std::ifstream::binary);
 		if(not sa){ std::cerr << "Error opening the SA file..." << std::endl; exit(1); }
 
-		char prev = 0, curr = 0; // previous and current BWT character
-		usafe_t curr_sa = 0, prev_sa = 0, bwt_length = 0; // previous and current SA entry
-		// Vector of pairs associating each end-of-run sample with
-		// the corresponding beginning-of-run sample.
-		std::vector<std::pair<usafe_t,usafe_t>> last_first;
+		builder b;
+		char curr = 0; // current BWT character
+		usafe_t curr_sa = 0; // current SA entry
+		while(bwt.read(&curr,1) and sa.read(reinterpret_cast<char*>(&curr_sa), STORE_SIZE))
+			b.push(curr_sa,curr);
 
-		bwt.seekg(0, bwt.end);
-		bwt_length = bwt.tellg(); 
-		// skip first entry for $
-		bwt.seekg(1, bwt.beg); sa.seekg(STORE_SIZE, sa.beg);
-
-		// read the first bwt character and SA entry 
-		bwt.read(&prev,1);
-		sa.read(reinterpret_cast<char*>(&prev_sa), STORE_SIZE);
-		
-		usafe_t i=0;
-		while(i++<bwt_length)
-		{
-			bwt.read(&curr,1);
-			sa.read(reinterpret_cast<char*>(&curr_sa), STORE_SIZE);
+		build(b,verbose);
 
-			if(curr != prev)
-			{
-				last_first.push_back(std::make_pair(prev_sa-1,curr_sa-1));
-
-				prev = curr;
-			}
+		bwt.close();
+		sa.close();
+	}
 
-			prev_sa = curr_sa;
-		}
+	void build(builder& b, bool_t /*verbose*/ = true, usafe_t threads = 1)
+	{
 		// set last SA entry
-		L = prev_sa-1;
+		L = b.prev_sa-1;
 
 		// sort end-of-run samples in increasing order
-		std::sort(last_first.begin(), last_first.end(), [](auto &left, auto &right) {
+		parallel_sort(b.last_first.begin(), b.last_first.end(), [](const std::pair<usafe_t,usafe_t> &left,
+		                                                           const std::pair<usafe_t,usafe_t> &right) {
 		    return left.first < right.first;
-		});
+		}, threads);
 
 		// construct a sorted dictionary storing (end of run, beginning of run) sample pairs
-		LFsamples.build(last_first,bwt_length,bitsize(uint64_t(bwt_length)));
+		LFsamples.build(b.last_first,b.n,bitsize(uint64_t(b.n)));
 
-		bwt.close();
-		sa.close();
+		std::vector<std::pair<usafe_t,usafe_t>>().swap(b.last_first);
 	}
 
 	int_t phi_safe(const uint_t idx) const
@@ -74,6 +99,15 @@ public:
 		else{ return -1; }
 	}
 
+	static const int PREFETCH_STAGES = sux::bits::InterleavedEliasFano<>::PREFETCH_STAGES;
+
+	// prefetch stage (0 to PREFETCH_STAGES-1) of the memory read by phi_safe(idx), see
+	// InterleavedEliasFano::prefetch_successor()
+	void prefetch(const uint_t idx, const int stage) const
+	{
+		if(idx != L){ LFsamples.prefetch_successor(idx,stage); }
+	}
+
 	int_t phi_unsafe(const uint_t idx) const
 	{
 		auto res = LFsamples.successor_value(idx);
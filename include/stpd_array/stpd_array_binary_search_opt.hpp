@@ -11,6 +11,8 @@
 
 #include <cmath>
 #include <common.hpp>
+#include <file_io.hpp>
+#include <parallel.hpp>
 
 #include <elias_fano_intlv.hpp> // elias fano dictionary data structure
 
@@ -99,32 +101,58 @@ public:
 		}
 
 		{ // Construct Elias-Fano binary search data structure
-			usafe_t offset = 0, i = 0;
-			std::ifstream file_text(textFile, std::ios::binary);
-			if (!file_text.is_open()){ std::cerr << "Error: Could not open " << textFile << std::endl; exit(1); }
-
-			safe_t curr = 0;
-			for(i=0; i<S; ++i)
-			{
-				curr = key_value[i].second >> log_l;
+			mapped_file file_text(textFile);
+			file_text.advise_sequential(true);
+			build_elias_fano(key_value, file_text.data());
+		}
+	}
 
-				std::string text_buffer(this->len,'A');
-				safe_t beg = std::max(static_cast<safe_t>(0),curr-this->len+1);
-				safe_t len_s = std::min(static_cast<safe_t>(this->len),curr+1);
+	// in-memory constructor: samples contains the (STPD sample, LCS value) pairs in
+	// colex order and is reused for the key-value pairs; text without the 0 terminator
+	// O_ is only stored, so it can be built concurrently
+	void build(const sdsl::int_vector<8>& text, std::vector<std::pair<usafe_t,usafe_t>>& samples,
+	           text_oracle_ds* O_,
+	           bool_t large_ = false, safe_t len_ = 15, bool_t verbose = true, usafe_t threads = 1)
+	{
+		build(reinterpret_cast<const uchar_t*>(text.data()), text.size(), samples, O_, large_, len_, verbose, threads);
+	}
 
-				file_text.seekg(beg, std::ios::beg);
-				file_text.read(&text_buffer[this->len-len_s], len_s);
-			  	file_text.clear();
+	// same as above for a text of n characters, e.g. memory mapped
+	void build(const uchar_t* text, usafe_t n, std::vector<std::pair<usafe_t,usafe_t>>& samples,
+	           text_oracle_ds* O_,
+	           bool_t large_ = false, safe_t len_ = 15, bool_t verbose = true, usafe_t threads = 1)
+	{
+		{ // set input parameters
+			this->large = large_;
+			this->O = O_;
+			this->N = n;
+			this->len = len_;
+			this->S = samples.size();
+		}
+		{ // compite width of samples and lcs entries
+		    this->log_n = bitsize(this->N);
+		    this->log_l = bitsize(this->len);
 
-			  	bitpack_uint_DNA(reinterpret_cast<uint8_t*>(&offset),text_buffer);
-				key_value[i].first = offset;
-				offset = 0;
-			}
-			// compute the Elias-Fano data structure
-			ef.build(key_value,pow(SIGMA_DNA,this->len),log_n+log_l);
+		    if(verbose)
+		    	std::cout << "		- STPD samples width = " << log_n << " bits per entry" << std::endl
+		                  << "		- LCS values width = " << log_l << " bits per entry" << std::endl;
+		}
+		// bitpack the sample and lcs values
+		for(auto& kv : samples)
+		{
+			usafe_t b = std::min(kv.second, static_cast<usafe_t>(this->len));
+			kv.second = ((0ULL | kv.first) << log_l) | b;
+		}
 
-			file_text.close();
+		if(verbose) 
+		{
+			std::cout << "		- STPD array size = " << this->S <<
+			std::endl << "		- Text size = " << this->N <<
+			std::endl << "		- N/S = " << double(this->N)/S << std::endl;
 		}
+
+		// Construct Elias-Fano binary search data structure
+		build_elias_fano(samples, text, threads);
 	}
 
 	usafe_t sA_size() const { return this->S; }
@@ -218,7 +246,7 @@ public:
 		binary_search_lower_bound(const std::string& P, usafe_t b, usafe_t e) const
 	{
 		usafe_t plen = e - b;
-		assert(plen >= this->len);
+		assert(plen >= usafe_t(this->len));
 		uint_t to_match = this->len;
 
 		// bitpack first to_match characters
@@ -232,7 +260,7 @@ public:
 		if(std::get<0>(res) < 0){ return std::make_tuple(-1,0,1); }
 
 		// run the binary search if needed
-		if(std::get<0>(res)+1 == std::get<1>(res))
+		if(usafe_t(std::get<0>(res)+1) == std::get<1>(res))
 		{
 			usafe_t lcp = O->LCS(P, e-1-this->len, (std::get<2>(res) >> log_l)-this->len) + this->len;
 
@@ -243,7 +271,7 @@ public:
 			auto bs_res =
 			ef.binary_search_text_oracle(P, b, e, std::get<0>(res), std::get<1>(res)-1, log_l, O);
 
-			return std::make_tuple(std::get<0>(bs_res),std::get<1>(bs_res),std::get<1>(bs_res) != plen);
+			return std::make_tuple(std::get<0>(bs_res),std::get<1>(bs_res),usafe_t(std::get<1>(bs_res)) != plen);
 		}
 	}
 	
@@ -254,6 +282,55 @@ public:
 
 private:
 
+	// key each packed (sample, lcs) value by the bitpacked len characters ending at the
+	// sample and build the Elias-Fano dictionary. The keys are computed in one sequential
+	// pass over text: the samples are bucketed by 64K-character text block with a counting
+	// sort and sorted by position within each block (blocks split among threads), and a rolling key (the character at
+	// offset k from the window start in bits 2k, 2k+1, as in bitpack_uint_DNA) is shifted
+	// by one character at every text position. The pairs are then appended in colex order
+	void build_elias_fano(std::vector<std::pair<usafe_t,usafe_t>>& key_value, const uchar_t* text,
+	                      usafe_t threads = 1)
+	{
+		const usafe_t block = 16;
+		std::vector<uint_t> order(this->S);
+		std::vector<usafe_t> start((this->N >> block) + 2, 0);
+		{ // counting sort of the samples by text block
+			for(usafe_t i=0; i<S; ++i)
+				start[((key_value[i].second >> log_l) >> block) + 1]++;
+			for(usafe_t b=1; b<start.size(); ++b)
+				start[b] += start[b-1];
+
+			std::vector<usafe_t> next(start.begin(), start.end()-1);
+			for(usafe_t i=0; i<S; ++i)
+				order[next[(key_value[i].second >> log_l) >> block]++] = i;
+		}
+		parallel_for(start.size()-1, threads, [&](usafe_t b_, usafe_t e_){
+			for(usafe_t b=b_; b<e_; ++b)
+				std::sort(order.begin()+start[b], order.begin()+start[b+1], [&](uint_t x, uint_t y){
+					return key_value[x].second < key_value[y].second; });
+		});
+
+		{ // rolling key over the text
+			const uchar_t top = 2*(this->len-1);
+			usafe_t key = 0, t = 0;
+			for(uint_t i : order)
+			{
+				usafe_t curr = key_value[i].second >> log_l;
+				for(; t <= curr; ++t)
+					key = (key >> 2) | (static_cast<usafe_t>(dna_to_code_table[text[t]]) << top);
+				key_value[i].first = key;
+			}
+		}
+		std::vector<uint_t>().swap(order);
+		std::vector<usafe_t>().swap(start);
+
+		// compute the Elias-Fano data structure
+		ef.init(this->S,pow(SIGMA_DNA,this->len),log_n+log_l);
+		for(usafe_t i=0; i<S; ++i)
+			ef.push_back(key_value[i].first,key_value[i].second);
+		ef.finalize();
+	}
+
 	void inline bitpack_uint_DNA(uchar_t* t, const std::string& p, uchar_t len, 
 	                                                  usafe_t beg, uchar_t plen) const
 	{
@@ -262,7 +339,7 @@ private:
 	    uchar_t offset = 4-(size%4);
 	    for(uint_t i=0;i<plen;++i)
 	        t[((size-i-1)/4)] |= 
-	        bit_mask_table[(dna_to_code_table[p[beg+plen-i-1]]*4)+((offset+i)%4)];
+	        bit_mask_table[(dna_to_code_table[(uchar_t)p[beg+plen-i-1]]*4)+((offset+i)%4)];
 	}
 
 	void inline bitpack_uint_DNA(uchar_t* t, const std::string& p) const
@@ -271,7 +348,7 @@ private:
 	    uchar_t offset = 4-(size%4); 
 	    for(uint_t i=0;i<size;++i)
 	        t[((size-i-1)/4)] |= 
-	        bit_mask_table[(dna_to_code_table[p[size-i-1]]*4)+((offset+i)%4)];
+	        bit_mask_table[(dna_to_code_table[(uchar_t)p[size-i-1]]*4)+((offset+i)%4)];
 	}
 
 	std::tuple<safe_t,usafe_t,usafe_t> 
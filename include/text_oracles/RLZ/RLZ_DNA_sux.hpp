@@ -6,55 +6,152 @@
 #include <vector>
 #include <fstream>
 #include <cassert>
+#include <memory>
+#include <algorithm>
+#include <unordered_set>
+#include <thread>
 
 #include <sdsl/construct.hpp>
 #include <sdsl/bits.hpp>
 #include <elias_fano_sux.hpp>
+#include <common.hpp>
+#include <file_io.hpp>
 
 template < class SD_VECTOR = sux::bits::EliasFano<> >
 struct RLZ_DNA_sux { 
     // ASSUME: ALPHABET = { 'A', 'C', 'G', 'T' }     ( capital letters )
 
     static const uint64_t RLZ_HEADER = (0x0e8f0000 + 0x0002);
+    static const uint64_t RLZ_SAMPLED_HEADER = (0x0e8f0000 + 0x0003); // reference not a text prefix
+    static const uint64_t RLZ_SHARED_HEADER = (0x0e8f0000 + 0x0004); // reference stored by another oracle
+    static const size_t BATCH_LENGTH = 1<<24; // reference characters of a batch of candidates (see build)
+
+    // build the reference from segments sampled across the text (see segment_sampler)
+    // instead of taking the text prefix
+    bool sampled_reference = false;
 
     //typedef typename SD_VECTOR::rank_1_type   rank_t;
     //typedef typename SD_VECTOR::select_1_type select_t;
 
-    struct builder {
-        typedef std::tuple<size_t,size_t,unsigned char> phrase_t;
+    // Phrases (offset, length, code of the explicit character) packed in fixed-width
+    // fields. Offsets and lengths are bounded by the reference length, so the widths are
+    // known before parsing and the parse takes 2*log(reference)+2 bits per phrase
+    struct phrase_vector {
+        phrase_vector( size_t ref_len = 0 )
+        : w( sdsl::bits::hi( std::max<size_t>( ref_len, 0xff ) ) + 1 ) {
+            ;
+        }
+
+        size_t  size  ( void ) const { return n; }
+        size_t  offset( size_t i ) const { return get( i*(2*w+2), w ); }
+        size_t  length( size_t i ) const { return get( i*(2*w+2)+w, w ); }
+        uint8_t code  ( size_t i ) const { return get( i*(2*w+2)+2*w, 2 ); }
+
+        void push_back( size_t offset, size_t length, uint8_t code ) {
+            size_t p = n++ * (2*w+2);
+            bits.resize( (n*(2*w+2)+63)/64 );
+            set( p, offset, w );
+            set( p+w, length, w );
+            set( p+2*w, code, 2 );
+        }
+
+        void append( const phrase_vector& v ) {
+            for( size_t i = 0; i < v.size(); ++i ) push_back( v.offset(i), v.length(i), v.code(i) );
+        }
+
+        private:
+        uint64_t get( size_t p, uint8_t len ) const {
+            size_t i = p>>6, o = p&63;
+            uint64_t x = bits[i] >> o;
+            if( o + len > 64 ) x |= bits[i+1] << (64-o);
+            return len == 64 ? x : x & ((((uint64_t)1)<<len)-1);
+        }
+
+        // fields are written once, on zeroed words
+        void set( size_t p, uint64_t x, uint8_t len ) {
+            size_t i = p>>6, o = p&63;
+            bits[i] |= x << o;
+            if( o + len > 64 ) bits[i+1] |= x >> (64-o);
+        }
+
+        uint8_t w; // width of offsets and lengths
+        size_t n = 0;
+        std::vector<uint64_t> bits;
+    };
 
-        builder( const sdsl::int_vector<8>* _text )
-        : text(*_text), prefix_len(0) {
+    // The text is only read through a pointer, so it can be memory mapped. The reference
+    // SA has 32-bit or 64-bit entries depending on the reference length and is then
+    // bit-compressed, so references may exceed 4 GB
+    struct builder {
+        builder( const uint8_t* _text, size_t _text_len )
+        : text(_text), text_len(_text_len), ref_data(_text), prefix_len(0), begin(0) {
             ;
         }
 
-        builder( const sdsl::int_vector<8>* _text, size_t _prefix_len )
-        : text(*_text), prefix_len(_prefix_len) {
-            if( text.size() < prefix_len ) prefix_len = text.size();
-            sdsl::int_vector<8> text_prefix; text_prefix.resize( prefix_len );
-            for( size_t i = 0; i < prefix_len; ++i ) {
-                text_prefix[i] = text[i];
+        // with threads > 1 the text after the reference is split into one chunk per
+        // thread, parsed concurrently against the shared reference SA (see do_parse_parallel).
+        // With parse_text = false only the reference SA is built, for estimate_phrases()
+        builder( const uint8_t* _text, size_t _text_len, size_t _prefix_len, size_t threads = 1, bool parse_text = true )
+        : text(_text), text_len(_text_len), ref_data(_text), prefix_len(_prefix_len) {
+            if( text_len < prefix_len ) prefix_len = text_len;
+            begin = prefix_len;
+            { // the SA is built on a 0-terminated copy, then the text prefix is the reference
+                sdsl::int_vector<8> text_prefix; text_prefix.resize( prefix_len );
+                for( size_t i = 0; i < prefix_len; ++i ) {
+                    text_prefix[i] = text[i];
+                }
+                sdsl::append_zero_symbol(text_prefix);
+                build_sa( text_prefix );
             }
-            sdsl::append_zero_symbol(text_prefix);
-            sdsl::algorithm::calculate_sa<>( (const unsigned char*) text_prefix.data(), text_prefix.size(), sa );
 
-            phrase = do_parse( prefix_len, prefix_len );
+            if( parse_text ) parse( threads );
+        }
+
+        // reference _ref (without 0 terminator) that is not a text prefix: the whole text is parsed
+        builder( const uint8_t* _text, size_t _text_len, sdsl::int_vector<8> _ref, size_t threads = 1, bool parse_text = true )
+        : text(_text), text_len(_text_len), ref(std::move(_ref)), prefix_len(ref.size()), begin(0) {
+            sdsl::append_zero_symbol(ref);
+            build_sa( ref );
+            ref_data = (const uint8_t*) ref.data();
+
+            if( parse_text ) parse( threads );
+        }
+
+        builder( const builder& ) = delete;
+        builder& operator = ( const builder& ) = delete;
+
+        void parse( size_t threads = 1 ) {
+            phrase = do_parse_parallel( begin, prefix_len, threads );
         }
 
-        builder& operator = ( const builder& _b ) {
-            assert( &text == &_b.text );
-            sa = _b.sa;
-            prefix_len = _b.prefix_len;
-            phrase = _b.phrase;
-            return *this;
+        // Estimated number of phrases of the parse of text[begin, m), extrapolated from
+        // the parse of blocks blocks of block_len characters evenly spaced over it. The
+        // estimate is exact when the blocks would cover the whole range
+        size_t estimate_phrases( size_t blocks = 64, size_t block_len = 1<<16 ) {
+            size_t m = text_len;
+            if( m <= begin ) return 0;
+            if( m - begin <= blocks * block_len ) return do_parse( begin, prefix_len, m ).size();
+
+            size_t step = (m - begin) / blocks, count = 0;
+            for( size_t k = 0; k < blocks; ++k ) {
+                size_t b = begin + k * step;
+                count += do_parse( b, prefix_len, b + block_len ).size();
+            }
+            return std::max<size_t>( 1, (double)count * (m - begin) / (blocks * block_len) + 0.5 );
         }
 
         private:
+        void build_sa( const sdsl::int_vector<8>& r ) {
+            sa = sdsl::int_vector<>( 0, 0, r.size() < 0x7FFFFFFFULL ? 32 : 64 );
+            sdsl::algorithm::calculate_sa<>( (const unsigned char*) r.data(), r.size(), sa );
+            sdsl::util::bit_compress( sa );
+        }
+
         size_t refine_lower_bound( size_t s, size_t e, size_t j, unsigned char x ) {
             size_t n = sa[0];
             while( s < e ) {
                 size_t m = (s+e)/2;
-                if( sa[m]+j >= n || text[ sa[m]+j ] < x ) {
+                if( sa[m]+j >= n || ref_data[ sa[m]+j ] < x ) {
                     s=m+1;
                 } else {
                     e=m;
@@ -68,7 +165,7 @@ struct RLZ_DNA_sux {
             size_t n = sa[0];
             while( s < e ) {
                 size_t m = (s+e)/2;
-                if( sa[m]+j >= n || text[ sa[m]+j ] <= x ) {
+                if( sa[m]+j >= n || ref_data[ sa[m]+j ] <= x ) {
                     s=m+1;
                 } else {
                     e=m;
@@ -78,9 +175,9 @@ struct RLZ_DNA_sux {
             return s;
         }
 
-        std::pair<size_t,size_t> match( size_t j0 = 0, size_t max_phrase_length = 0 ) {
-            size_t n = sa[0];
-            size_t m = text.size();
+        // longest match of text[j0, end) in the reference
+        std::pair<size_t,size_t> match( size_t j0, size_t max_phrase_length, size_t end ) {
+            size_t m = end;
             if( max_phrase_length != 0 && j0 + max_phrase_length < m ) m = j0 + max_phrase_length;
             size_t s = 0;
             size_t e = sa.size();
@@ -96,31 +193,141 @@ struct RLZ_DNA_sux {
             return std::make_pair( max_i, max_lcp );
         }
 
-        std::vector< std::tuple<size_t,size_t,unsigned char> > do_parse( size_t j, size_t max_phrase_length ) {
-            size_t m = text.size();
-            std::vector< std::tuple<size_t,size_t,unsigned char> > ret;    
-            while( j < m ) {
-                std::pair<size_t,size_t> r = match( j, max_phrase_length );
+        // greedy parse of text[j, end); before the end of the text, phrases and their
+        // explicit character do not cross end
+        phrase_vector do_parse( size_t j, size_t max_phrase_length, size_t end ) {
+            size_t m = text_len;
+            size_t match_end = end < m ? end-1 : m;
+            phrase_vector ret( prefix_len );
+            while( j < end ) {
+                std::pair<size_t,size_t> r = match( j, max_phrase_length, match_end );
                 j += r.second;
-                if( j < m ) ret.push_back( std::make_tuple( r.first, r.second, (unsigned char)text[j] ) );
-                else        ret.push_back( std::make_tuple( r.first, r.second, (unsigned char)0    ) );
+                if( j < m ) ret.push_back( r.first, r.second, bit_packed_DNA_string::pack_char( text[j] ) );
+                else        ret.push_back( r.first, r.second, bit_packed_DNA_string::pack_char( 0 ) );
                 ++j;
             }
             return ret;
         }
 
-        const sdsl::int_vector<8>& text;
-        sdsl::int_vector<32> sa;
-        size_t prefix_len;
-        std::vector< phrase_t > phrase;
+        // Parse text[j, m) in one chunk per thread. Each chunk is parsed greedily on its own,
+        // so a phrase that would cross a chunk end is cut there and the phrase count grows
+        // by at most one per chunk; the phrases are concatenated in text order
+        phrase_vector do_parse_parallel( size_t j, size_t max_phrase_length, size_t threads ) {
+            size_t m = text_len;
+            const size_t min_chunk = 1<<16;
+            if( threads <= 1 || m <= j || m - j < 2 * min_chunk ) return do_parse( j, max_phrase_length, m );
+
+            threads = std::min( threads, (m - j) / min_chunk );
+            size_t chunk = (m - j + threads - 1) / threads;
+            std::vector< phrase_vector > parts( threads );
+            std::vector< std::thread > workers;
+            for( size_t k = 0; k < threads; ++k ) {
+                size_t b = j + k * chunk, e = std::min( m, b + chunk );
+                workers.emplace_back( [this, &parts, k, b, e, max_phrase_length]() {
+                    parts[k] = do_parse( b, max_phrase_length, e );
+                });
+            }
+            for( auto& w : workers ) w.join();
+
+            phrase_vector ret( prefix_len );
+            for( auto& p : parts ) {
+                ret.append( p );
+                p = phrase_vector();
+            }
+            return ret;
+        }
+
+        const uint8_t* text;
+        size_t text_len;
+        sdsl::int_vector<8> ref; // reference, 0-terminated, if it is not a text prefix
+        const uint8_t* ref_data; // reference characters
+        sdsl::int_vector<> sa;
+        size_t prefix_len; // reference length
+        size_t begin; // first parsed text position
+        phrase_vector phrase;
 
         public:
-        size_t total_length    ( void ) const { return text.size(); }
+        size_t total_length    ( void ) const { return text_len; }
         size_t reference_length( void ) const { return prefix_len; }
+        size_t parse_begin     ( void ) const { return begin; }
+        const uint8_t* reference_data( void ) const { return ref_data; }
         size_t num_phrases     ( void ) const { return phrase.size(); }
-        size_t phrase_offset   ( size_t i ) const { return std::get<0>(phrase[i]); }
-        size_t phrase_length   ( size_t i ) const { return std::get<1>(phrase[i]); }
-        size_t phrase_char     ( size_t i ) const { return std::get<2>(phrase[i]); }
+        size_t phrase_offset   ( size_t i ) const { return phrase.offset(i); }
+        size_t phrase_length   ( size_t i ) const { return phrase.length(i); }
+        uint8_t phrase_code    ( size_t i ) const { return phrase.code(i); }
+    };
+
+    // Picks segments of seg_len characters across the text for a sampled reference.
+    // Segments are visited in the bit-reversed order of their index, so that the visited
+    // ones spread evenly over the text, and a segment is kept if at least 1/8 of its
+    // sampled k-mers are not in the kept segments yet. The visit order is fixed, so a
+    // shorter reference is made of a prefix of the kept segments of a longer one
+    struct segment_sampler {
+        segment_sampler( const uint8_t* _text, size_t _text_len, size_t _seg_len = 1<<10 )
+        : text(_text), text_len(_text_len), seg_len(_seg_len) {
+            segs = (text_len + seg_len - 1) / seg_len;
+            bits = segs > 1 ? sdsl::bits::hi( segs-1 )+1 : 0;
+        }
+
+        // keep segments until they add up to len characters or the text is exhausted
+        void extend( size_t len ) {
+            std::vector<uint32_t> keys;
+            while( kept_len < len && next < (((size_t)1)<<bits) ) {
+                size_t s = 0, r = next++;
+                for( size_t k = 0; k < bits; ++k ) { s = (s<<1) | (r&1); r >>= 1; }
+                if( s >= segs ) continue;
+
+                size_t b = s * seg_len, e = std::min( text_len, b + seg_len );
+                kmers( b, e, keys );
+                size_t novel = 0;
+                for( uint32_t x : keys ) novel += seen.count( x ) == 0;
+                if( 8 * novel < keys.size() ) continue;
+
+                seen.insert( keys.begin(), keys.end() );
+                kept.push_back( std::make_pair( b, e ) );
+                kept_len += e - b;
+            }
+        }
+
+        // the first kept segments, up to len characters, concatenated in text order;
+        // call extend( len ) first
+        sdsl::int_vector<8> reference( size_t len ) const {
+            std::vector< std::pair<size_t,size_t> > r;
+            for( size_t i = 0, l = 0; i < kept.size() && l < len; ++i ) {
+                r.push_back( kept[i] );
+                r.back().second = std::min( r.back().second, r.back().first + len - l );
+                l += r.back().second - r.back().first;
+            }
+            std::sort( r.begin(), r.end() );
+
+            sdsl::int_vector<8> ref;
+            size_t l = 0;
+            for( auto& x : r ) l += x.second - x.first;
+            ref.resize( l );
+            l = 0;
+            for( auto& x : r )
+                for( size_t i = x.first; i < x.second; ++i ) ref[l++] = text[i];
+            return ref;
+        }
+
+        private:
+        static const size_t k = 16;
+
+        // 2-bit packed k-mers of text[b, e), one in 8 on average by hash value
+        void kmers( size_t b, size_t e, std::vector<uint32_t>& keys ) const {
+            keys.clear();
+            uint32_t x = 0;
+            for( size_t i = b; i < e; ++i ) {
+                x = (x<<2) | bit_packed_DNA_string::pack_char( text[i] );
+                if( i+1 >= b+k && ((x * 2654435761u) >> 29) == 0 ) keys.push_back( x );
+            }
+        }
+
+        const uint8_t* text;
+        size_t text_len, seg_len, segs, bits;
+        size_t next = 0, kept_len = 0; // next visit, length of the kept segments
+        std::vector< std::pair<size_t,size_t> > kept;
+        std::unordered_set<uint32_t> seen;
     };
 
     struct bit_packed_DNA_string {
@@ -145,11 +352,16 @@ struct RLZ_DNA_sux {
         }
 
         static uint16_t get_packed_chunk_from_vec_8( const sdsl::int_vector<8>& x, size_t i ) {
-            if( i+8 <= x.size() ) { return pack_uint64( *(uint64_t*)((char*)x.data()+i) ); }
+            return get_packed_chunk( (const uint8_t*)x.data(), x.size(), i );
+        }
+
+        // the 8 characters of x[i, n) starting at i, packed
+        static uint16_t get_packed_chunk( const uint8_t* x, size_t n, size_t i ) {
+            if( i+8 <= n ) { return pack_uint64( *(uint64_t*)(x+i) ); }
             else {
                 uint64_t v = 0;
                 uint64_t o = 0;
-                while( i < x.size() ) {
+                while( i < n ) {
                     v |= (((uint64_t)x[i++]) << ((o++)<<3) );
                 }
                 return pack_uint64( v );
@@ -157,13 +369,18 @@ struct RLZ_DNA_sux {
         }
 
         void build( const sdsl::int_vector<8>& t, size_t i, size_t j ) {
+            build( (const uint8_t*)t.data(), t.size(), i, j );
+        }
+
+        // t[i, j) of a text of n characters
+        void build( const uint8_t* t, size_t n, size_t i, size_t j ) {
             len = j-i;
             seq.resize( (j-i+31)/32 );
             size_t x   = 0;
             size_t cnt = 0;
             size_t write_i = 0;
             while( i < j ) {
-                uint64_t chunk = get_packed_chunk_from_vec_8(t,i);
+                uint64_t chunk = get_packed_chunk(t,n,i);
                 x |= chunk << (cnt<<4);
                 if( ++cnt == 4 ) {
                     seq[write_i++] = x;
@@ -221,114 +438,182 @@ struct RLZ_DNA_sux {
         sdsl::int_vector<64> seq;
     };
 
-    void build( const std::string& input_filename, double epsilon = 1.0, size_t __prefix_len = 0 ) {
-        sdsl::int_vector<8> text;
-        sdsl::load_vector_from_file(text, input_filename, 1);
+    // the text file is memory mapped instead of loaded
+    void build( const std::string& input_filename, double epsilon = 1.0, size_t __prefix_len = 0, size_t threads = 1 ) {
+        {
+            mapped_file text( input_filename );
+            build( text.data(), text.size(), epsilon, __prefix_len, threads );
+        }
 
-        size_t text_len   = text.size();
-        size_t prefix_len = __prefix_len;
+        std::ofstream fout( input_filename + ".rlz", std::ios::binary );
+        serialize( fout );
+        fout.close();
+    }
 
-        size_t p_b, prefix_size_upper_bound;
-        if( prefix_len == 0 ) {
-            p_b = std::min( (((uint64_t)1)<<20), (uint64_t)text_len/1024+1 );
-            prefix_size_upper_bound = std::min( (uint64_t)text_len, ((uint64_t)1)<<(64-2)) ;
-        } else {
-            p_b = prefix_len; 
-            prefix_size_upper_bound = p_b+1;
+    void build( const std::string& input_filename, size_t __prefix_len, size_t threads = 1 ) {
+        {
+            mapped_file text( input_filename );
+            build( text.data(), text.size(), __prefix_len, threads );
         }
-        size_t min_size = 0;
-        builder b(&text);
-        while( p_b < prefix_size_upper_bound ) { 
-            builder b_(&text, p_b);
-            size_t m = b_.num_phrases();
-
-            size_t size_estimated = p_b * 2  // size of bit-pack string
-                                  + m * ( 2 + (log(text_len) - log(m))/log(2) // Boundary
-                                  + sdsl::bits::hi(p_b-1)+1 + 2 );            // Phrase
-
-            if( min_size == 0 || size_estimated < min_size ) {
-                min_size = size_estimated;
-                b = b_;
-                prefix_len = p_b;
-            }
-            if( size_estimated > min_size ) {
-                break;
-            }
-            
+
+        std::ofstream fout( input_filename + ".rlz", std::ios::binary );
+        serialize( fout );
+        fout.close();
+    }
+
+    // in-memory construction, text must not contain the 0 terminator.
+    // Without a reference length, the candidate lengths grow by a factor 1+epsilon and
+    // the first local minimum of the estimated size is chosen. Each candidate only parses
+    // a sample of the text (builder::estimate_phrases), and the SA of the chosen reference
+    // is reused for the final parse; every candidate builds the SA of its own reference.
+    // Up to threads candidates are evaluated at once, in batches whose references total
+    // at most BATCH_LENGTH characters or twice the first reference of the batch, so that
+    // for long references a batch takes about the memory of a sequential scan.
+    // With sampled_reference, the candidates share the segments of one segment_sampler
+    void build( const sdsl::int_vector<8>& text, double epsilon = 1.0, size_t __prefix_len = 0, size_t threads = 1 ) {
+        build( (const uint8_t*)text.data(), text.size(), epsilon, __prefix_len, threads );
+    }
+
+    void build( const sdsl::int_vector<8>& text, size_t __prefix_len, size_t threads = 1 ) {
+        build( (const uint8_t*)text.data(), text.size(), __prefix_len, threads );
+    }
+
+    // construction from a text of text_len characters, e.g. memory mapped
+    void build( const uint8_t* text, size_t text_len, double epsilon = 1.0, size_t __prefix_len = 0, size_t threads = 1 ) {
+        if( __prefix_len != 0 ) { build( text, text_len, __prefix_len, threads ); return; }
+
+
+        std::vector<size_t> candidates;
+        size_t p_b = std::min( (((uint64_t)1)<<20), (uint64_t)text_len/1024+1 );
+        size_t prefix_size_upper_bound = std::min( (uint64_t)text_len, ((uint64_t)1)<<(64-2)) ;
+        while( p_b < prefix_size_upper_bound ) {
+            candidates.push_back( p_b );
             if( p_b == (size_t)((1+epsilon)*p_b) ) ++p_b;
             else p_b = (1+epsilon)*p_b;
         }
-        total_length = text_len;
-        reference.build( text, 0, prefix_len );
+        if( candidates.empty() ) { build( text, text_len, builder( text, text_len ) ); return; }
 
-        parse_info.resize( b.num_phrases() );
-        std::vector<uint64_t> onset{ 0 }; onset.resize(b.num_phrases()+1);
-        size_t relative_offset = 0;
-        for( size_t i = 0; i < b.num_phrases(); ++i ) {
-            relative_offset += b.phrase_length(i)+1;
-            onset.push_back( relative_offset );
-            parse_info[i] = (((uint64_t)b.phrase_offset(i)) << 2 ) | bit_packed_DNA_string::pack_char( (uint8_t)b.phrase_char(i) );
+        if( threads == 0 ) threads = 1;
+        std::unique_ptr<segment_sampler> sampler;
+        if( sampled_reference ) sampler.reset( new segment_sampler( text, text_len ) );
+        size_t min_size = 0;
+        std::unique_ptr<builder> b;
+        bool done = false;
+        for( size_t c = 0, batch = 0; c < candidates.size() && !done; c += batch ) {
+            size_t total = candidates[c], limit = std::max( size_t( BATCH_LENGTH ), 2*candidates[c] );
+            for( batch = 1; batch < threads && c+batch < candidates.size()
+                            && total + candidates[c+batch] <= limit; ++batch )
+                total += candidates[c+batch];
+            std::vector< std::unique_ptr<builder> > b_( batch );
+            std::vector<size_t> m( batch );
+            if( sampler ) sampler->extend( candidates[c+batch-1] );
+            auto evaluate = [&]( size_t k ) {
+                if( sampler ) b_[k].reset( new builder( text, text_len, sampler->reference( candidates[c+k] ), 1, false ) );
+                else          b_[k].reset( new builder( text, text_len, candidates[c+k], 1, false ) );
+                m[k] = b_[k]->estimate_phrases();
+            };
+            std::vector< std::thread > workers;
+            for( size_t k = 1; k < batch; ++k ) workers.emplace_back( evaluate, k );
+            evaluate( 0 );
+            for( auto& w : workers ) w.join();
+
+            // same selection as a sequential scan of the candidates
+            for( size_t k = 0; k < batch; ++k ) {
+                size_t p = b_[k]->reference_length();
+                size_t size_estimated = p * 2  // size of bit-pack string
+                                      + m[k] * ( 2 + (log(text_len) - log(m[k]))/log(2) // Boundary
+                                      + sdsl::bits::hi(p-1)+1 + 2 );                    // Phrase
+
+                if( min_size == 0 || size_estimated < min_size ) {
+                    min_size = size_estimated;
+                    b = std::move( b_[k] );
+                }
+                if( size_estimated > min_size ) {
+                    done = true;
+                    break;
+                }
+            }
         }
-        sdsl::util::bit_compress( parse_info );
 
-        size_t i = 1;
-        uint64_t prev = onset[0];
-        for(size_t i_=1;i_<onset.size();++i_)
-        {
-            if( prev != onset[i_] )
-            { prev = onset[i_]; onset[i++] = prev; } 
+        b->parse( threads );
+        build( text, text_len, *b );
+    }
+
+    void build( const uint8_t* text, size_t text_len, size_t __prefix_len, size_t threads = 1 ) {
+        if( sampled_reference ) {
+            segment_sampler sampler( text, text_len );
+            sampler.extend( __prefix_len );
+            builder b(text, text_len, sampler.reference( __prefix_len ), threads);
+            build( text, text_len, b );
+            return;
         }
-        onset.resize(i);
-        boundary.build( onset, text_len-prefix_len+2 );
+        builder b(text, text_len, __prefix_len, threads);
+        build( text, text_len, b );
+    }
 
-        std::ofstream fout( input_filename + ".rlz", std::ios::binary );
-        serialize( fout );
-        fout.close();
+    // parse text against the reference of another oracle, e.g. for text appended to the
+    // text of that oracle: only the SA of the reference is built besides the parse
+    void build( const sdsl::int_vector<8>& text, const RLZ_DNA_sux& other, size_t threads = 1 ) {
+        build( (const uint8_t*)text.data(), text.size(), other, threads );
     }
 
-    void build( const std::string& input_filename, size_t __prefix_len ) {
-        sdsl::int_vector<8> text;
-        sdsl::load_vector_from_file(text, input_filename, 1);
+    void build( const uint8_t* text, size_t text_len, const RLZ_DNA_sux& other, size_t threads = 1 ) {
+        sdsl::int_vector<8> ref; ref.resize( other.reference->len );
+        for( size_t i = 0; i < ref.size(); ++i ) ref[i] = other.reference->extract_unsafe( i );
+        builder b( text, text_len, std::move(ref), threads );
+        build( text, text_len, b, other.reference );
+    }
 
-        size_t text_len   = text.size();
-        size_t prefix_len = __prefix_len;
+    // reference, boundaries and phrases from a parse of text; shared is the reference of
+    // the parse if it belongs to another oracle
+    void build( const uint8_t* text, size_t text_len, const builder& b,
+                std::shared_ptr<const bit_packed_DNA_string> shared = nullptr ) {
+        size_t prefix_len = b.reference_length();
 
-        builder b(&text, prefix_len);
-        
         total_length = text_len;
-        reference.build( text, 0, prefix_len );
+        parse_begin = b.parse_begin();
+        if( shared ) reference = shared;
+        else {
+            auto ref = std::make_shared<bit_packed_DNA_string>();
+            if( parse_begin == prefix_len ) ref->build( text, text_len, 0, prefix_len );
+            else ref->build( b.reference_data(), prefix_len+1, 0, prefix_len );
+            reference = ref;
+        }
 
+        // phrase ends are strictly increasing, so onset needs no deduplication
+        parse_info.width( sdsl::bits::hi( std::max<size_t>( prefix_len, 0xff ) ) + 3 );
         parse_info.resize( b.num_phrases() );
-        std::vector<uint64_t> onset{ 0 }; onset.resize(b.num_phrases()+1);
+        std::vector<uint64_t> onset; onset.reserve( b.num_phrases()+1 );
+        onset.push_back( 0 );
         size_t relative_offset = 0;
         for( size_t i = 0; i < b.num_phrases(); ++i ) {
             relative_offset += b.phrase_length(i)+1;
             onset.push_back( relative_offset );
-            parse_info[i] = (((uint64_t)b.phrase_offset(i)) << 2 ) | bit_packed_DNA_string::pack_char( (uint8_t)b.phrase_char(i) );
+            parse_info[i] = (((uint64_t)b.phrase_offset(i)) << 2 ) | b.phrase_code(i);
         }
         sdsl::util::bit_compress( parse_info );
 
-        size_t i = 1;
-        uint64_t prev = onset[0];
-        for(size_t i_=1;i_<onset.size();++i_)
-        {
-            if( prev != onset[i_] )
-            { prev = onset[i_]; onset[i++] = prev; } 
-        }
-        onset.resize(i);
-        boundary.build( onset, text_len-prefix_len+2 );
-
-        std::ofstream fout( input_filename + ".rlz", std::ios::binary );
-        serialize( fout );
-        fout.close();
+        boundary.build( onset, text_len-parse_begin+2 );
     }
 
     size_t serialize( std::ostream& out ) {
         size_t ret = 0;
-        uint64_t header = RLZ_HEADER;
+        uint64_t header = parse_begin == reference->len ? RLZ_HEADER : RLZ_SAMPLED_HEADER;
+        ret += sdsl::serialize( header, out );
+        ret += sdsl::serialize( total_length, out );
+        ret += reference->serialize( out );
+        ret += boundary.serialize( out );
+        ret += sdsl::serialize( parse_info, out );
+        return ret;
+    }
+
+    // serialize without the reference, for an oracle built against the reference of
+    // another one (see build( text, other )): load it with load( in, &other )
+    size_t serialize_shared( std::ostream& out ) {
+        size_t ret = 0;
+        uint64_t header = RLZ_SHARED_HEADER;
         ret += sdsl::serialize( header, out );
         ret += sdsl::serialize( total_length, out );
-        ret += reference.serialize( out );
         ret += boundary.serialize( out );
         ret += sdsl::serialize( parse_info, out );
         return ret;
@@ -336,8 +621,8 @@ struct RLZ_DNA_sux {
 
     unsigned char extract( size_t i ) const {
         if( i >= total_length ) return '\0';
-        if( i < reference.len ) return reference.extract( i );
-        i -= reference.len;
+        if( i < parse_begin ) return reference->extract( i );
+        i -= parse_begin;
         size_t blk_id    = boundary.rank1(i+1)-1;
         size_t p_info    = parse_info[blk_id];
         size_t offset    = p_info >>   2;
@@ -350,16 +635,16 @@ struct RLZ_DNA_sux {
         assert( i <= next_begin );
 
         if( next_begin == i+1 ) return ch;
-        return reference.extract_unsafe( offset + i - curr_begin ); 
+        return reference->extract_unsafe( offset + i - curr_begin ); 
     }
 
     size_t LCP( const std::string& P, size_t p, size_t t ) const {
         if( t >= total_length ) return 0;
-        size_t rlen = reference.len;
+        size_t rlen = parse_begin;
         size_t m    = P.size();
         size_t l    = 0;
         while( p+l < m && t+l < rlen ) {
-            unsigned char ch = reference.extract_unsafe( t+l );
+            unsigned char ch = reference->extract_unsafe( t+l );
             if( P[p+l] != ch ) return l;
             ++l;
         }
@@ -378,7 +663,7 @@ struct RLZ_DNA_sux {
         while( p+l < m && t+l < total_length ) {
 
             while( remaining > 0 && p+l < m && t+l < total_length ) {
-                unsigned char ch = reference.extract_unsafe( offset++ );
+                unsigned char ch = reference->extract_unsafe( offset++ );
                 if( P[p+l] != ch ) return l;
                 ++l;
                 --remaining;
@@ -404,13 +689,12 @@ struct RLZ_DNA_sux {
 
     std::pair<size_t,char> LCS_char( const std::string& P, size_t p, size_t t ) const {
         if( t >= total_length ) return std::make_pair(0,(unsigned char)-1);
-        size_t rlen = reference.len;
-        size_t m    = P.size();
+        size_t rlen = parse_begin;
         size_t l    = 0;
 
         if( t < rlen ) {
             while( l <= p && l <= t ) {
-                unsigned char ch = reference.extract_unsafe( t-l );
+                unsigned char ch = reference->extract_unsafe( t-l );
                 if( P[p-l] != ch ) return std::make_pair(l,ch);
                 ++l;
             }
@@ -427,7 +711,7 @@ struct RLZ_DNA_sux {
 
         size_t remaining  = ( t - rlen ) - curr_begin + 1;
 
-        while( l <= p && t-l >= rlen ) {
+        while( l <= p && l <= t && t-l >= rlen ) {
             if( remaining > 0 && remaining == next_begin - curr_begin ) {
                 if( P[p-l] != ch_last ) return std::make_pair(l,ch_last);
                 ++l;
@@ -436,13 +720,13 @@ struct RLZ_DNA_sux {
 
             // scan
             while( remaining > 0 && l <= p && t-l >= rlen ) {
-                unsigned char ch = reference.extract_unsafe( offset+remaining-1 );
+                unsigned char ch = reference->extract_unsafe( offset+remaining-1 );
                 if( P[p-l] != ch ) return std::make_pair(l,ch);
                 ++l;
                 --remaining;
             }
             if( p<l ) return std::make_pair(l,(unsigned char)-1);
-            if( t-l <= rlen ) break;
+            if( l > t || t-l < rlen ) break;
 
             //load block
             p_info  = parse_info[--blk_id];
@@ -455,7 +739,7 @@ struct RLZ_DNA_sux {
         }
 
         while( l <= p && l <= t ) {
-            unsigned char ch = reference.extract_unsafe( t-l );
+            unsigned char ch = reference->extract_unsafe( t-l );
             if( P[p-l] != ch ) return std::make_pair(l,ch);
             ++l;
         }
@@ -463,12 +747,20 @@ struct RLZ_DNA_sux {
         return std::make_pair(l,(unsigned char)-1);
     }
 
-    bool load( std::ifstream& in ) {
+    // shared: the oracle whose reference was used, for the oracles stored by serialize_shared()
+    bool load( std::ifstream& in, const RLZ_DNA_sux* shared = nullptr ) {
         uint64_t header;
         sdsl::read_member( header, in );
-        if( header != RLZ_HEADER ) return false;
+        if( header != RLZ_HEADER && header != RLZ_SAMPLED_HEADER && header != RLZ_SHARED_HEADER ) return false;
+        if( header == RLZ_SHARED_HEADER && shared == nullptr ) return false;
         sdsl::read_member( total_length, in );
-        reference .load( in );
+        if( header == RLZ_SHARED_HEADER ) reference = shared->reference; // not copied
+        else {
+            auto ref = std::make_shared<bit_packed_DNA_string>();
+            ref->load( in );
+            reference = ref;
+        }
+        parse_begin = header == RLZ_HEADER ? reference->len : 0;
         boundary  .load( in );
         parse_info.load( in );
         return !!in;
@@ -485,7 +777,8 @@ struct RLZ_DNA_sux {
     size_t text_length() const { return total_length; }
 
     uint64_t     total_length;
-    bit_packed_DNA_string reference;
+    uint64_t     parse_begin; // text[0, parse_begin) is the reference, the rest is parsed
+    std::shared_ptr<const bit_packed_DNA_string> reference; // shared by the oracles parsed against it
     SD_VECTOR    boundary;
     sdsl::int_vector<>  parse_info;
 };
@@ -2,9 +2,14 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <sstream>
+#include <cstdio>
 #include <unistd.h>
+#include <getopt.h>
 
 #include "stpd-index.hpp"
+#include <path_decomposition.hpp>
+#include <path_decomposition_se.hpp>
 
 void help(){
 
@@ -15,6 +20,18 @@ void help(){
     //"-v <arg>    Index variant: (colex-|colex+-). (REQUIRED)" << std::endl <<
     //"-O <arg>    Enable DNA index optimizations: (v1|v2|v3). (Def. False)" << std::endl <<
     "-l <arg>    RLZ reference sequence length (if known). (Def. None)" << std::endl <<
+    "-r          Build the RLZ reference from segments sampled across the text instead of its prefix. (Def. False)" << std::endl <<
+    "-t <arg>    Number of threads used to compute the path decomposition and the index components. (Def. 1)" << std::endl <<
+    "-f          Compute the PA, LCS and reversed BWT with prefix-free parsing. (Def. False)" << std::endl <<
+    "-m <arg>    --mem-limit: RAM budget in MiB for a semi-external path decomposition. (Def. None)" << std::endl <<
+    "-s <arg>    Scratch directory for the -m construction. (Def. directory of the input text)" << std::endl <<
+    "-I <arg>    Build from the precomputed inputs <arg>.bwt.heads, .bwt.len, .ssa, .esa, .stpd and .rlz (see README). (Def. None)" << std::endl <<
+    "-w <arg>    Integer width in bytes of the -I inputs and -R checkpoints: 5 (40-bit packed) or 8 (64-bit). (Def. 5)" << std::endl <<
+    "-R          --resume: checkpoint each construction phase in <output>.ckpt.* and resume from the phases completed by a previous run. (Def. False)" << std::endl <<
+    "-P <arg>    --profile: write a per-phase build report (time, peak heap, I/O, output size) in JSON to <arg> and print it as a table. (Def. None)" << std::endl <<
+    "-v          Print the planned and the achieved peak memory of the path decomposition. (Def. False)" << std::endl <<
+    "-a          --append: index the input text as appended to the text of the existing index -o, which is extended in place. (Def. False)" << std::endl <<
+    "-L <arg>    Longest pattern whose occurrences across the boundary of an appended text (-a) are found. (Def. 1024)" << std::endl <<
     "-o <arg>    Output index file path. (REQUIRED)" << std::endl;
     exit(0);
 } 
@@ -28,12 +45,20 @@ int main(int argc, char* argv[])
         exit(1);
     }
 
-    std::string inputPath, outputPath; // indexVariant, optVariant;
-    bool verbose = false;
-    size_t refLen = 0;
+    std::string inputPath, outputPath, scratchDir, ingestPrefix, profilePath; // indexVariant, optVariant;
+    bool verbose = false, pfp = false, sampledRef = false, resume = false, append = false;
+    size_t refLen = 0, threads = 1, memLimit = 0, intBytes = STORE_SIZE, maxPattern = 1024;
+
+    static struct option longOptions[] = {
+        {"mem-limit", required_argument, 0, 'm'},
+        {"resume", no_argument, 0, 'R'},
+        {"profile", required_argument, 0, 'P'},
+        {"append", no_argument, 0, 'a'},
+        {0, 0, 0, 0}
+    };
 
     int opt;
-    while ((opt = getopt(argc, argv, "hi:o:v:O:l:")) != -1)
+    while ((opt = getopt_long(argc, argv, "hi:o:vO:l:rt:fm:s:I:w:RP:aL:", longOptions, nullptr)) != -1)
     {
         switch (opt){
             case 'h':
@@ -51,9 +76,45 @@ int main(int argc, char* argv[])
             //case 'v':
             //    indexVariant = std::string(optarg);
             //break;
+            case 'v':
+                verbose = true;
+            break;
             case 'l':
                 refLen = std::atoll(optarg);
             break;
+            case 'r':
+                sampledRef = true;
+            break;
+            case 't':
+                threads = std::max(1, std::atoi(optarg));
+            break;
+            case 'f':
+                pfp = true;
+            break;
+            case 'm':
+                memLimit = std::atoll(optarg) << 20;
+            break;
+            case 's':
+                scratchDir = std::string(optarg);
+            break;
+            case 'I':
+                ingestPrefix = std::string(optarg);
+            break;
+            case 'w':
+                intBytes = std::atoi(optarg);
+            break;
+            case 'R':
+                resume = true;
+            break;
+            case 'P':
+                profilePath = std::string(optarg);
+            break;
+            case 'a':
+                append = true;
+            break;
+            case 'L':
+                maxPattern = std::max(1LL, std::atoll(optarg));
+            break;
             default:
                 help();
             return -1;
@@ -61,36 +122,198 @@ int main(int argc, char* argv[])
     }
 
     if(inputPath == "" or outputPath == ""){ help(); }
+    if(memLimit > 0 and pfp)
+    {
+        std::cerr << "Error: -f cannot be combined with -m" << std::endl;
+        exit(1);
+    }
+    if(ingestPrefix != "" and (memLimit > 0 or pfp or resume))
+    {
+        std::cerr << "Error: -I cannot be combined with -m, -f or -R" << std::endl;
+        exit(1);
+    }
+    if(append and (ingestPrefix != "" or resume))
+    {
+        std::cerr << "Error: -a cannot be combined with -I or -R" << std::endl;
+        exit(1);
+    }
+    if(append and not std::ifstream(outputPath))
+    {
+        std::cerr << "Error: -a needs an existing index, could not open " << outputPath << std::endl;
+        exit(1);
+    }
+    if(intBytes != 5 and intBytes != 8)
+    {
+        std::cerr << "Error: -w must be 5 or 8" << std::endl;
+        exit(1);
+    }
+
+    {
+        std::ifstream text(inputPath, std::ios::binary | std::ios::ate);
+        if(not text.is_open() or text.tellg() < 0)
+        {
+            std::cerr << "Error: Could not open the input text " << inputPath << std::endl;
+            exit(1);
+        }
+        // 32-bit indexes address texts shorter than 2^31 characters
+        if(not M64 and static_cast<usafe_t>(text.tellg()) >= (1ULL << 31) - 1)
+        {
+            std::cerr << "Error: the input text is too large for a 32-bit index, "
+                      << "use build_store_stpd_index64 and locate64 instead..." << std::endl;
+            exit(1);
+        }
+    }
 
     std::cout << "\n[INFO] Constructing and storing the Suffix Tree path decomposition index (STDP-index)" 
               << " for " << inputPath << "\n" << std::endl;
 
-    { // compute the path decomposition
+    stpd::stpd_index<stpd::stpd_array_binary_search_opt<>,
+                     RLZ_DNA_sux<>,stpd::r_index_phi_inv_intlv> index;
+    index.sampled_reference = sampledRef;
+
+    build_profiler profiler;
+    profiler.heap_peak = malloc_count_peak;
+    profiler.heap_reset_peak = malloc_count_reset_peak;
+    if(profilePath != ""){ index.profiler = &profiler; }
+
+    // print and write the build report (-P)
+    auto report = [&]()
+    {
+        if(profilePath != "")
+        {
+            profiler.print_table(std::cout);
+            std::ofstream json(profilePath);
+            profiler.write_json(json);
+            if(json.fail()){ std::cerr << "Error: Could not write " << profilePath << std::endl; exit(1); }
+        }
+    };
+    // store the index and the build report
+    auto store = [&](){ index.store(outputPath); report(); };
+
+    sdsl::int_vector<8> text;
+    std::string prefix; // end of the indexed text, prepended to an appended text (-a)
+    auto load_text = [&]()
+    {
+        sdsl::load_vector_from_file(text, inputPath, 1);
+        if(prefix != "")
+        {
+            size_t n = text.size();
+            text.resize(prefix.size() + n);
+            for(size_t i = n; i-- > 0;){ text[prefix.size() + i] = text[i]; }
+            for(size_t i = 0; i < prefix.size(); ++i){ text[i] = prefix[i]; }
+        }
+        sdsl::append_zero_symbol(text);
+    };
+
+    // compute the path decomposition and pass it to consume
+    auto compute_pd = [&](auto consume)
+    {
         std::cout << "[STEP 0] Computing the ST path decomposition..." << "\n" << std::endl;
-        std::string command = "./build/sources/path-decomp-src/stpd_small -i " + inputPath + " -o " + inputPath + ".colex_m -c -P"; 
-        int result = std::system(command.c_str());
-        if (result != 0) {
-            std::cerr << "Error while computing the path decomposition..." << std::endl;
-            exit(1);
+        if(memLimit > 0)
+        { // the text is memory mapped by the path decomposition
+            if(scratchDir == "")
+            {
+                size_t slash = inputPath.find_last_of('/');
+                scratchDir = slash == std::string::npos ? "." : inputPath.substr(0, std::max<size_t>(slash, 1));
+            }
+            std::string textPath = inputPath;
+            if(prefix != "")
+            { // the text file is mapped, so the prefix is written before a copy of it
+                textPath = scratchDir + "/" + inputPath.substr(inputPath.find_last_of('/') + 1) + ".append";
+                std::ifstream in(inputPath, std::ios::binary);
+                std::ofstream out(textPath, std::ios::binary);
+                out << prefix << in.rdbuf();
+                out.close();
+                if(out.fail())
+                {
+                    std::cerr << "Error: Could not write " << textPath << std::endl;
+                    exit(1);
+                }
+            }
+            stpd::path_decomposition_se pd(textPath, memLimit, scratchDir);
+            pd.verbose = verbose;
+            pd.profiler = index.profiler;
+            pd.compute(true,false,false,false,true);
+            consume(pd);
+            if(textPath != inputPath){ std::remove(textPath.c_str()); }
         }
-    }
+        else
+        {
+            load_text();
+            if(text.size() < 0x7FFFFFFFULL)
+            {
+                stpd::path_decomposition<sdsl::int_vector<32>> pd(text);
+                pd.threads = threads;
+                pd.use_pfp = pfp;
+                pd.verbose = verbose;
+                pd.profiler = index.profiler;
+                pd.compute(true,false,false,false,true);
+                consume(pd);
+            }
+            else
+            {
+                stpd::path_decomposition<sdsl::int_vector<64>> pd(text);
+                pd.threads = threads;
+                pd.use_pfp = pfp;
+                pd.verbose = verbose;
+                pd.profiler = index.profiler;
+                pd.compute(true,false,false,false,true);
+                consume(pd);
+            }
+        }
+    };
 
-    { // compute the index
-        stpd::stpd_index<stpd::stpd_array_binary_search_opt<>,
-                         RLZ_DNA_sux<>,stpd::r_index_phi_inv_intlv> index;
-        index.build_colex_m(inputPath,inputPath+".colex_m",inputPath+".rbwt",
-                            inputPath+".pa",inputPath+".lcs",refLen);
-        // store the index
-        index.store(outputPath);
+    if(append)
+    { // the new text, after the last maxPattern-1 characters of the indexed one, is indexed
+      // as a segment written at the end of the index file
+        index.load(outputPath);
+        prefix = index.text_suffix(maxPattern - 1);
+        compute_pd([&](auto& pd){
+            if(text.empty()){ load_text(); }
+            index.append(text,pd,outputPath,prefix.size(),threads);
+        });
+        report();
+        return 0;
+    }
+    else if(ingestPrefix != "")
+    { // the path decomposition has been computed by other tools
+        index.build_colex_m(inputPath,ingestPrefix,intBytes,refLen,threads);
     }
+    else if(resume)
+    { // the path decomposition is checkpointed as ingestion inputs, the components as they complete
+        std::ostringstream config;
+        config << inputPath << " bytes=" << std::ifstream(inputPath, std::ios::binary | std::ios::ate).tellg()
+               << " fnv=" << std::hex << stpd::checkpoint::checksum(inputPath) << std::dec
+               << " l=" << refLen << " r=" << sampledRef << " w=" << intBytes << " m64=" << M64;
+        stpd::checkpoint ckpt(outputPath + ".ckpt", config.str(), true);
+
+        if(ckpt.valid("pd")){ std::cout << "[RESUME] Reusing the path decomposition of " << ckpt.file(".*") << "\n" << std::endl; }
+        else
+        {
+            compute_pd([&](auto& pd){
+                std::cout << "[STEP 0] Checkpointing the path decomposition..." << "\n" << std::endl;
+                build_profiler::phase ph(index.profiler, "checkpoint");
+                stpd::store_runs(pd, ckpt.file(""), intBytes);
+            });
+            sdsl::util::clear(text);
+            ckpt.commit("pd",{".bwt.heads",".bwt.len",".ssa",".esa",".stpd"});
+        }
+        index.build_colex_m(inputPath,ckpt.file(""),intBytes,refLen,threads,&ckpt);
 
-    { // delete temporary files
-        std::remove(std::string(inputPath+".colex_m").c_str());
-        std::remove(std::string(inputPath+".rbwt").c_str());
-        std::remove(std::string(inputPath+".pa").c_str());
-        std::remove(std::string(inputPath+".lcs").c_str());
-        std::remove(std::string(inputPath+".rlz").c_str());
+        store();
+        ckpt.clear();
+        return 0;
+    }
+    else
+    { // compute the path decomposition and the index
+        compute_pd([&](auto& pd){
+            if(text.empty()){ load_text(); }
+            index.build_colex_m(text,pd,refLen,threads);
+        });
     }
 
+    // store the index
+    store();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,147 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  checkpoint: manifest of the construction phases of the STPD-index. Each completed
+ *  phase records its output files with their size and checksum in prefix.manifest,
+ *  so that an interrupted construction resumes from the phases whose outputs are intact
+ */
+
+#ifndef CHECKPOINT_HPP_
+#define CHECKPOINT_HPP_
+
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <common.hpp>
+#include <file_io.hpp>
+
+namespace stpd{
+
+class checkpoint{
+
+public:
+
+	// config identifies the input text and the options the outputs depend on: the phases
+	// of an existing manifest are reused only if it has the same config and resume is set
+	checkpoint(const std::string &prefix_, const std::string &config_, bool_t resume) :
+		prefix(prefix_), config(config_)
+	{
+		if(resume){ read_manifest(); }
+		write_manifest();
+	}
+
+	checkpoint(const checkpoint&) = delete;
+	checkpoint& operator=(const checkpoint&) = delete;
+
+	// path of the checkpoint file with extension ext
+	std::string file(const std::string &ext) const { return prefix + ext; }
+
+	// true if the phase has completed and its files are unchanged
+	bool_t valid(const std::string &phase)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		return phases.count(phase) > 0;
+	}
+
+	// record the files (extensions) written by a completed phase
+	void commit(const std::string &phase, const std::vector<std::string> &exts)
+	{
+		std::vector<entry> files;
+		for(auto& ext : exts){ files.push_back(entry{ext, file_size(file(ext)), checksum(file(ext))}); }
+
+		std::lock_guard<std::mutex> lock(mtx);
+		phases[phase] = files;
+		write_manifest();
+	}
+
+	// remove the checkpoint files and the manifest once the index is stored
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		for(auto& p : phases)
+			for(auto& f : p.second){ std::remove(file(f.ext).c_str()); }
+		phases.clear();
+		std::remove(file(".manifest").c_str());
+	}
+
+	// 64-bit FNV-1a hash of the file content
+	static usafe_t checksum(const std::string &path)
+	{
+		mapped_file f(path);
+		f.advise_sequential(true);
+		usafe_t h = 0xcbf29ce484222325ULL;
+		for(usafe_t i = 0; i < f.size(); ++i){ h = (h ^ f.data()[i]) * 0x100000001b3ULL; }
+		return h;
+	}
+
+private:
+
+	struct entry{ std::string ext; usafe_t bytes, sum; };
+
+	static usafe_t file_size(const std::string &path)
+	{
+		struct stat st;
+		return stat(path.c_str(), &st) == 0 ? st.st_size : usafe_t(-1);
+	}
+
+	// manifest format: a "config <config>" line, then a "phase <name> <files>" line per
+	// phase followed by one "<extension> <bytes> <checksum>" line per file
+	void read_manifest()
+	{
+		std::ifstream in(file(".manifest"));
+		std::string line;
+		if(not std::getline(in,line) or line != "config " + config)
+		{
+			if(in.is_open()){ std::cout << "[RESUME] Checkpoint of a different input or options, starting over" << std::endl; }
+			return;
+		}
+		while(std::getline(in,line))
+		{
+			std::istringstream ss(line);
+			std::string tag, phase;
+			usafe_t n = 0;
+			if(not (ss >> tag >> phase >> n) or tag != "phase"){ break; }
+
+			std::vector<entry> files(n);
+			bool_t intact = true;
+			for(auto& f : files)
+			{
+				if(not std::getline(in,line)){ return; }
+				std::istringstream fs(line);
+				fs >> f.ext >> f.bytes >> std::hex >> f.sum;
+				intact = intact and file_size(file(f.ext)) == f.bytes and checksum(file(f.ext)) == f.sum;
+			}
+			if(intact){ phases[phase] = files; }
+			std::cout << "[RESUME] Phase " << phase << (intact ? " is complete" : " has damaged outputs and is rebuilt") << std::endl;
+		}
+	}
+
+	// written to a temporary file and renamed, so that the manifest is never partial
+	void write_manifest()
+	{
+		std::ofstream out(file(".manifest.tmp"));
+		out << "config " << config << "\n";
+		for(auto& p : phases)
+		{
+			out << "phase " << p.first << " " << p.second.size() << "\n";
+			for(auto& f : p.second){ out << f.ext << " " << f.bytes << " " << std::hex << f.sum << std::dec << "\n"; }
+		}
+		out.close();
+		if(out.fail() or std::rename(file(".manifest.tmp").c_str(), file(".manifest").c_str()) != 0)
+		{
+			std::cerr << "Error: Could not write " << file(".manifest") << std::endl;
+			exit(1);
+		}
+	}
+
+	std::string prefix, config;
+	std::map<std::string,std::vector<entry>> phases;
+	std::mutex mtx;
+};
+
+}
+
+#endif // CHECKPOINT_HPP_
@@ -13,7 +13,9 @@ void help(){
     "-h          Print usage info." << std::endl <<
     "-i <arg>    Input index filepath. (REQUIRED)" << std::endl <<
     "-p <arg>    Patterns FASTA file.  (REQUIRED)" << std::endl <<
-    "-t <arg>    Maximum number of occurrences to report per pattern. (Def. none)" << std::endl;
+    "-t <arg>    Maximum number of occurrences to report per pattern. (Def. none)" << std::endl <<
+    "-T <arg>    Number of threads running the queries. (Def. 1)" << std::endl <<
+    "-G <arg>    Number of queries whose phi walks are interleaved, at most 32. (Def. 1)" << std::endl;
     //"-O <arg>    Enable DNA index optimizations: (v1|v2|v3). (Def. False)" << std::endl;
     exit(0);
 } 
@@ -29,10 +31,11 @@ int main(int argc, char* argv[])
 
     std::string inputPath, patternFile; //optVariant;
     uint64_t maxOcc = (1ULL << 63) | ((1ULL << 63) - 1);
-    bool verbose = false;
+    uint64_t threads = 1;
+    uint64_t group = 1;
 
     int opt;
-    while ((opt = getopt(argc, argv, "hi:p:O:t:")) != -1)
+    while ((opt = getopt(argc, argv, "hi:p:O:t:T:G:")) != -1)
     {
         switch (opt){
             case 'h':
@@ -47,6 +50,12 @@ int main(int argc, char* argv[])
             case 't':
                 maxOcc = std::stoull(optarg);
             break;
+            case 'T':
+                threads = std::max(1, std::atoi(optarg));
+            break;
+            case 'G':
+                group = std::max(1, std::atoi(optarg));
+            break;
             //case 'O':
             //    optVariant = std::string(optarg);
             //break;
@@ -65,7 +74,7 @@ int main(int argc, char* argv[])
                          RLZ_DNA_sux<>,stpd::r_index_phi_inv_intlv> index;
         index.load(inputPath);
         // run locate all occurrence queries
-        index.locate_fasta(patternFile,maxOcc);
+        index.locate_fasta(patternFile,maxOcc,threads,group);
     }
 
     return 0;
@@ -10,12 +10,20 @@
 #define STPD_INDEX_HPP_
 
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <limits>
 #include <malloc_count.h> 
+#include <build_profiler.hpp>
+#include <file_io.hpp>
 
 #include <r-index_phi_inv_intlv.hpp> // phi function
 #include <RLZ_DNA_sux.hpp> // rlz random access text orcale
 #include <stpd_array_binary_search.hpp> // binary search ds
 #include <stpd_array_binary_search_opt.hpp> // optimized binary search ds
+#include "checkpoint.hpp" // resumable construction
 
 namespace stpd{
 
@@ -28,7 +36,23 @@ private:
 	textOracle O; // random access text oracle
 	STPDArray S; // stpd array binary search
 
+	// Texts appended after the construction (see append()) are indexed by segments:
+	// segment indexes over text[offset, offset + length) queried after this one, where
+	// text[offset, offset + overlap) is the end of the previous text, so that the
+	// occurrences ending after it and starting in the previous text are found
+	static const uint64_t SEGMENT_HEADER = 0x5e9d0002;
+	struct segment
+	{
+		usafe_t offset, overlap;
+		std::unique_ptr<stpd_index> index;
+	};
+	std::vector<segment> segments;
+
 public:
+
+	bool sampled_reference = false; // RLZ reference sampled across the text instead of a prefix
+	build_profiler* profiler = nullptr; // per-phase resource report of the build (if not nullptr)
+	const textOracle* reference_oracle = nullptr; // parse the text against the RLZ reference of this oracle
 	
 	stpd_index(){} // empty constructor
 
@@ -64,6 +88,206 @@ public:
 	  	std::cout << "[DONE] Index successfully built!" << "\n" << std::endl;
 	}
 
+	// in-process index constructor: streams the path decomposition pd, computed with
+	// colex- sampling and the LCS array, instead of reading the .colex_m, .pa, .lcs and
+	// .rbwt files. text is the 0-terminated text of pd; the terminator is removed
+	// once pd has been streamed and its arrays freed
+	// The text oracle, the STPD-array and the phi function only depend on the streamed
+	// path decomposition, so with threads > 1 they are built concurrently, the RLZ parse
+	// is split into chunks and the STPD-array and phi builds also sort in parallel
+	template<class pathDecomposition>
+	void build_colex_m(sdsl::int_vector<8> &text, pathDecomposition &pd, size_t refLen, size_t threads = 1)
+	{
+		std::cout << "[INFO] Constructing the STPD-index using the in-memory path decomposition" << "\n" << std::endl;
+		std::cout << "[STEP 1] Streaming the path decomposition..." << std::endl;
+		std::vector<std::pair<usafe_t,usafe_t>> samples; // (STPD sample, LCS value) pairs in colex order
+		typename phiFunction::builder phi_builder;
+		{
+			build_profiler::phase ph(profiler,"stream");
+			pd.for_each_colex([&](usafe_t x, char c, usafe_t lcs, bool sampled){
+				if(sampled){ samples.push_back(std::make_pair(x-1,lcs)); }
+				phi_builder.push(x,c);
+			});
+		}
+		pd.clear();
+		text.resize(text.size()-1);
+
+		auto build_oracle = [&](){
+			build_profiler::phase ph(profiler,"RLZ parse");
+			O.sampled_reference = sampled_reference;
+			if(reference_oracle != nullptr){ O.build(text,*reference_oracle,threads); }
+			else if(refLen > 0){ O.build(text,refLen,threads); }
+			else{ O.build(text,1.0,0,threads); }
+		};
+		auto build_stpd_array = [&](){
+			build_profiler::phase ph(profiler,"EF build");
+			S.build(text,samples,&O,false,15,false,threads);
+		};
+		auto build_phi = [&](){
+			build_profiler::phase ph(profiler,"phi build");
+			phi.build(phi_builder,true,threads);
+		};
+
+		if(threads > 1)
+		{
+			std::cout << "[STEP 2-4] Constructing the random-access text oracle, the STPD-array binary search " <<
+			             "data structure and the phi function concurrently..." << "\n" << std::endl;
+			std::thread oracle(build_oracle), phi_function(build_phi);
+			build_stpd_array();
+			oracle.join();
+			phi_function.join();
+		}
+		else
+		{
+			std::cout << "[STEP 2] Constructing the random-access text oracle..." << std::endl;
+			build_oracle();
+			std::cout << "[STEP 3] Constructing the STPD-array binary search data structure..." << std::endl;
+			build_stpd_array();
+			std::cout << "[STEP 4] Constructing the phi function..." << "\n" << std::endl;
+			build_phi();
+		}
+
+	  	std::cout << "[DONE] Index successfully built!" << "\n" << std::endl;
+	}
+
+	// ingestion constructor: builds the index from externally computed inputs instead of
+	// a path decomposition, with integers stored in int_bytes (5 or 8) bytes each:
+	// - prefix.bwt.heads, prefix.bwt.len: run heads (1 byte each) and run lengths of the
+	//   BWT of the reversed text, i.e. the .rbwt file of stpd_small, run-length encoded
+	// - prefix.ssa, prefix.esa: (BWT position, PA value) pairs at the first and at the
+	//   last position of each run, with the PA values of the .pa file of stpd_small
+	// - prefix.stpd: (STPD sample, LCS value) pairs in colex order, where the sample is
+	//   the .colex_m value and the LCS value is the .lcs entry of its position
+	// - prefix.rlz: the serialized text oracle; built from the text if it does not exist
+	// With a checkpoint, the oracle, the STPD-array and the phi function are stored in
+	// prefix.rlz, .stpd_array and .phi as they complete and reloaded if the manifest
+	// records them as complete: an existing prefix.rlz is used only in that case
+	void build_colex_m(const std::string &text_filepath, const std::string &prefix, usafe_t int_bytes,
+	                   size_t refLen, size_t threads = 1, checkpoint *ckpt = nullptr)
+	{
+		std::cout << "[INFO] Constructing the STPD-index from the inputs " << prefix << ".*" << "\n" << std::endl;
+		mapped_file text(text_filepath);
+		usafe_t N = text.size() + 1;
+		bool_t has_O = ckpt != nullptr and ckpt->valid("oracle"),
+		       has_S = ckpt != nullptr and ckpt->valid("stpd_array"),
+		       has_phi = ckpt != nullptr and ckpt->valid("phi");
+
+		std::cout << "[STEP 1] Reading the run-length BWT and the run samples..." << std::endl;
+		typename phiFunction::builder phi_builder;
+		std::vector<std::pair<usafe_t,usafe_t>> samples; // (STPD sample, LCS value) pairs in colex order
+		{
+			build_profiler::phase ph(profiler,"read runs");
+			if(not has_phi)
+			{
+				std::ifstream heads(prefix + ".bwt.heads", std::ios::binary);
+				if(not heads.is_open()){ std::cerr << "Error: Could not open " << prefix << ".bwt.heads" << std::endl; exit(1); }
+				int_file_reader lens(prefix + ".bwt.len", int_bytes);
+				int_file_reader ssa(prefix + ".ssa", int_bytes), esa(prefix + ".esa", int_bytes);
+				if(ssa.size() != 2*lens.size() or esa.size() != 2*lens.size())
+				{
+					std::cerr << "Error: the .ssa and .esa files must have one pair per BWT run" << std::endl;
+					exit(1);
+				}
+
+				char c;
+				usafe_t len, pos, first_sa, end_pos, last_sa, i = 0;
+				while(heads.read(&c,1) and lens.next(len))
+				{
+					ssa.next(pos); ssa.next(first_sa);
+					esa.next(end_pos); esa.next(last_sa);
+					if(len == 0 or pos != i or end_pos != i+len-1)
+					{
+						std::cerr << "Error: the run samples do not match the run lengths at BWT position " << i << std::endl;
+						exit(1);
+					}
+					phi_builder.push_run(c,len,first_sa,last_sa);
+					i += len;
+				}
+				if(i != N)
+				{
+					std::cerr << "Error: the BWT has " << i << " entries, the text " << N << std::endl;
+					exit(1);
+				}
+			}
+
+			if(not has_S)
+			{
+				int_file_reader stpd(prefix + ".stpd", int_bytes);
+				samples.resize(stpd.size()/2);
+				for(auto& kv : samples){ stpd.next(kv.first); stpd.next(kv.second); }
+			}
+		}
+
+		// store a completed component in the checkpoint file ext of phase
+		auto store_phase = [&](const std::string &phase, const std::string &ext, std::function<void(std::ostream&)> f){
+			if(ckpt == nullptr){ return; }
+			std::ofstream out(ckpt->file(ext), std::ios::binary);
+			f(out);
+			out.close();
+			ckpt->commit(phase,{ext});
+		};
+		auto build_oracle = [&](){
+			build_profiler::phase ph(profiler,"RLZ parse");
+			if(has_O or (ckpt == nullptr and O.load(prefix + ".rlz")))
+			{
+				if(has_O and not O.load(ckpt->file(".rlz"))){ std::cerr << "Error: Could not load " << ckpt->file(".rlz") << std::endl; exit(1); }
+				return;
+			}
+			O.sampled_reference = sampled_reference;
+			if(refLen > 0){ O.build(text.data(),text.size(),refLen,threads); }
+			else{ O.build(text.data(),text.size(),1.0,0,threads); }
+			store_phase("oracle",".rlz",[&](std::ostream &out){ O.serialize(out); });
+		};
+		auto build_stpd_array = [&](){
+			build_profiler::phase ph(profiler,"EF build");
+			if(has_S)
+			{
+				std::ifstream in(ckpt->file(".stpd_array"), std::ios::binary);
+				S.load(in,&O);
+				return;
+			}
+			S.build(text.data(),text.size(),samples,&O,false,15,false,threads);
+			store_phase("stpd_array",".stpd_array",[&](std::ostream &out){ S.serialize(out); });
+		};
+		auto build_phi = [&](){
+			build_profiler::phase ph(profiler,"phi build");
+			if(has_phi)
+			{
+				std::ifstream in(ckpt->file(".phi"), std::ios::binary);
+				phi.load(in);
+				return;
+			}
+			phi.build(phi_builder,true,threads);
+			store_phase("phi",".phi",[&](std::ostream &out){ phi.serialize(out); });
+		};
+
+		if(threads > 1)
+		{
+			std::cout << "[STEP 2-4] Loading or constructing the random-access text oracle, the STPD-array binary search " <<
+			             "data structure and the phi function concurrently..." << "\n" << std::endl;
+			std::thread oracle(build_oracle), phi_function(build_phi);
+			build_stpd_array();
+			oracle.join();
+			phi_function.join();
+		}
+		else
+		{
+			std::cout << "[STEP 2] Loading or constructing the random-access text oracle..." << std::endl;
+			build_oracle();
+			std::cout << "[STEP 3] Constructing the STPD-array binary search data structure..." << std::endl;
+			build_stpd_array();
+			std::cout << "[STEP 4] Constructing the phi function..." << "\n" << std::endl;
+			build_phi();
+		}
+		if(O.text_length() != text.size())
+		{
+			std::cerr << "Error: the text oracle " << prefix << ".rlz is not built on " << text_filepath << std::endl;
+			exit(1);
+		}
+
+	  	std::cout << "[DONE] Index successfully built!" << "\n" << std::endl;
+	}
+
 	/*
 	void build_colex_pm(const std::string &text_filepath, const std::string &sampling_filepath,
 		                const std::string &rbwt_filepath, const std::string &pa_filepath, size_t refLen)
@@ -83,6 +307,7 @@ public:
 	
 	usafe_t store(const std::string &index_filepath)
 	{
+		build_profiler::phase ph(profiler,"serialize");
 		std::ofstream out(index_filepath);
 		std::cout << "[INFO] Writing components to disk:" << std::endl;
 
@@ -93,12 +318,25 @@ public:
 		usafe_t phi_size = phi.serialize(out);
 		std::cout << "		- Phi-function data structure size = " << phi_size << " bytes" << "\n" << std::endl;
 
+		usafe_t seg_bytes = 0;
+		for(auto& seg : segments){ seg_bytes += store_segment(out,seg); }
+		if(segments.size() > 0)
+			std::cout << "		- Appended segments size = " << seg_bytes << " bytes (" << segments.size() << " segments)" << "\n" << std::endl;
+
 		std::cout << "[DONE] Index successfully stored!" << std::endl;
-		std::cout << "		→ Total index size in disk = " << O_bytes + S_bytes + phi_size << " bytes" << "\n" << std::endl;
+		std::cout << "		→ Total index size in disk = " << O_bytes + S_bytes + phi_size + seg_bytes << " bytes" << "\n" << std::endl;
 		
 		out.close();
 
-		return O_bytes + S_bytes + phi_size;
+		ph.output(O_bytes + S_bytes + phi_size + seg_bytes);
+		if(profiler != nullptr)
+		{
+			profiler->output("RLZ parse",O_bytes);
+			profiler->output("EF build",S_bytes);
+			profiler->output("phi build",phi_size);
+		}
+
+		return O_bytes + S_bytes + phi_size + seg_bytes;
 	}
 	
 	void load(const std::string &index_filepath)
@@ -113,76 +351,454 @@ public:
 		std::cout << "		- Phi-function data structure..." << "\n" << std::endl;
 		phi.load(in);
 
+		uint64_t header;
+		while(in.read((char*)&header,sizeof(header)))
+		{
+			if(header != SEGMENT_HEADER)
+			{
+				std::cerr << "Error: " << index_filepath << " is corrupted after segment " << segments.size() << std::endl;
+				exit(1);
+			}
+			segment seg;
+			in.read((char*)&seg.offset,sizeof(seg.offset));
+			in.read((char*)&seg.overlap,sizeof(seg.overlap));
+			seg.index.reset(new stpd_index);
+			if(not seg.index->O.load(in,&O))
+			{
+				std::cerr << "Error: Could not load the text oracle of segment " << segments.size()+1 << std::endl;
+				exit(1);
+			}
+			seg.index->S.load(in,&(seg.index->O));
+			seg.index->phi.load(in);
+			segments.push_back(std::move(seg));
+		}
+		if(segments.size() > 0)
+			std::cout << "		- Appended segments: " << segments.size() << "\n" << std::endl;
+
 		std::cout << "[DONE] Index successfully loaded!" << "\n" << std::endl;
 
 		in.close();
 	}
 
-	// locate all occurrences exponential search
+	// length of the indexed text, including the appended texts
+	usafe_t text_length() const
+	{
+		if(segments.empty()){ return O.text_length(); }
+		return segments.back().offset + segments.back().index->O.text_length();
+	}
+
+	// the last len characters of the indexed text, or all of it if it is shorter
+	std::string text_suffix(usafe_t len) const
+	{
+		usafe_t n = text_length();
+		len = std::min(len,n);
+		std::string suffix(len,'\0');
+		for(usafe_t i = 0; i < len; ++i)
+		{
+			auto o = oracle_at(n-len+i);
+			suffix[i] = o.first->extract(o.second);
+		}
+		return suffix;
+	}
+
+	// longest pattern whose occurrences across the boundaries of the appended segments
+	// are all found: the overlap of a segment plus one, unless it covers the whole
+	// previous text
+	usafe_t max_pattern_length() const
+	{
+		usafe_t m = std::numeric_limits<usafe_t>::max();
+		for(auto& seg : segments)
+			if(seg.offset > 0){ m = std::min(m,seg.overlap+1); }
+		return m;
+	}
+
+	// Index text (whose path decomposition is pd) as if it were appended to the indexed
+	// text: its RLZ parse reuses the reference of this index, and the new segment is
+	// written at the end of index_filepath, which must hold this index, so the cost is
+	// proportional to the appended text. text starts with text_suffix(overlap), so that
+	// the occurrences spanning the end of the previous text and the beginning of the
+	// appended one are found for patterns of length up to overlap+1
+	template<class pathDecomposition>
+	void append(sdsl::int_vector<8> &text, pathDecomposition &pd, const std::string &index_filepath,
+	            usafe_t overlap, size_t threads = 1)
+	{
+		segment seg;
+		seg.offset = text_length() - overlap;
+		seg.overlap = overlap;
+		if(not M64 and seg.offset + text.size() >= (1ULL << 31))
+		{
+			std::cerr << "Error: the appended text is too large for a 32-bit index" << std::endl;
+			exit(1);
+		}
+		seg.index.reset(new stpd_index);
+		seg.index->profiler = profiler;
+		seg.index->reference_oracle = &O;
+		seg.index->build_colex_m(text,pd,0,threads);
+
+		build_profiler::phase ph(profiler,"serialize");
+		std::ofstream out(index_filepath, std::ios::binary | std::ios::app);
+		usafe_t bytes = store_segment(out,seg);
+		out.close();
+		if(out.fail())
+		{
+			std::cerr << "Error: Could not append to " << index_filepath << std::endl;
+			exit(1);
+		}
+		ph.output(bytes);
+		segments.push_back(std::move(seg));
+
+		std::cout << "[DONE] Text appended at position " << segments.back().offset + overlap << " as segment "
+		          << segments.size() << " (" << bytes << " bytes)" << "\n" << std::endl;
+	}
+
+	// Lazy cursor over the occurrences of a pattern, in the order of locate_pattern_exp_search().
+	// The phi chain is walked and verified one block at a time: the block size doubles from 2
+	// up to BLOCK, and a block is accepted by checking its last position only (the occurrences
+	// are contiguous in the chain). Blocks live in the cursor, so no heap memory is used; the
+	// pattern must outlive the cursor
+	class occurrence_cursor{
+
+	public:
+
+		// store the next occurrence in occ, false if there are no more occurrences
+		bool_t next(uint_t &occ)
+		{
+			if(pos == len and not refill()){ return false; }
+			occ = block[pos++];
+			return true;
+		}
+
+		// store up to k next occurrences in out, return how many were stored
+		usafe_t next_block(uint_t *out, usafe_t k)
+		{
+			usafe_t j = 0;
+			while(j < k and (pos < len or refill()))
+				for(; j < k and pos < len; ++j){ out[j] = block[pos++]; }
+			return j;
+		}
+
+	private:
+
+		friend class stpd_index;
+
+		static const usafe_t BLOCK = 256;
+
+		occurrence_cursor(const stpd_index *index_, const std::string &pattern_) :
+			index(index_), pattern(pattern_) {}
+
+		// verify the next block of the current index, moving to the next segment when the
+		// chain of the current one is over; false if all indexes are done
+		bool_t refill()
+		{
+			pos = len = 0;
+			usafe_t m = pattern.size();
+			while(len == 0)
+			{
+				while(occ < 0)
+				{
+					if(seg > index->segments.size()){ return false; }
+					curr = seg == 0 ? index : index->segments[seg-1].index.get();
+					offset = seg == 0 ? 0 : index->segments[seg-1].offset;
+					overlap = seg == 0 ? 0 : index->segments[seg-1].overlap;
+					occ = curr->first_occurrence(pattern);
+					size = 2;
+					seg++;
+				}
+
+				while(len < size and occ >= 0)
+				{
+					block[len++] = occ;
+					occ = curr->phi.phi_safe(occ);
+				}
+
+				if(curr->O.LCS(pattern,m-1,block[len-1]) < m)
+				{
+					usafe_t low = 0, high = len;
+					curr->binary_search_occs(low,high,m,pattern,block);
+					len = low;
+					occ = -1; // no occurrences after the first mismatch
+				}
+				else{ size = std::min(2*size,usafe_t(BLOCK)); }
+
+				// the occurrences ending in the overlap are found in the previous indexes
+				usafe_t j = 0;
+				for(usafe_t i = 0; i < len; ++i)
+					if(block[i] >= overlap){ block[j++] = block[i] + offset; }
+				len = j;
+			}
+			return true;
+		}
+
+		const stpd_index *index, *curr = nullptr;
+		const std::string &pattern;
+		usafe_t seg = 0, offset = 0, overlap = 0, size = 2, pos = 0, len = 0;
+		int_t occ = -1; // next position of the chain, -1 when the chain is over
+		uint_t block[BLOCK];
+	};
+
+	// lazy cursor over the occurrences of pattern, in this index and in the appended segments;
+	// pattern must not be longer than max_pattern_length()
+	occurrence_cursor locate_cursor(const std::string &pattern) const
+	{
+		return occurrence_cursor(this,pattern);
+	}
+
+	// Per-thread buffers of the allocation-free queries (see locate()): the occurrences of
+	// the last query and the line buffers of locate_fasta(). They keep their capacity across
+	// queries, so once they have grown to the largest query a query allocates no heap memory
+	struct query_context
+	{
+		std::vector<uint_t> occs; // occurrences of the last query
+		std::string header, pattern; // FASTA header and pattern buffers
+	};
+
+	// locate up to limit occurrences of pattern in ctx.occs, in the order of
+	// locate_pattern_exp_search(), and return their number; pattern must not be longer
+	// than max_pattern_length()
+	usafe_t locate(const std::string &pattern, query_context &ctx,
+	               usafe_t limit = std::numeric_limits<usafe_t>::max()) const
+	{
+		ctx.occs.clear();
+		for(usafe_t s = 0; s <= segments.size() and ctx.occs.size() < limit; ++s)
+		{
+			const stpd_index *index = s == 0 ? this : segments[s-1].index.get();
+			int_t occ = index->first_occurrence(pattern);
+			if(occ < 0){ continue; }
+
+			usafe_t b = ctx.occs.size();
+			if(s == 0){ index->exp_search(pattern,occ,limit-b,ctx.occs); }
+			else
+			{
+				index->exp_search(pattern,occ,segment_limit(limit-b,segments[s-1]),ctx.occs);
+				shift_occs(ctx.occs,b,limit-b,segments[s-1]);
+			}
+		}
+		return ctx.occs.size();
+	}
+
+	static const usafe_t MAX_GROUP = 32; // maximum number of interleaved queries
+
+	// locate() for the patterns of ctx[0,g), g <= MAX_GROUP, with their phi walks
+	// interleaved (see exp_search_group()); the occurrences are the same as locate()
+	void locate_group(query_context *ctx, usafe_t g,
+	                  usafe_t limit = std::numeric_limits<usafe_t>::max()) const
+	{
+		phi_walk w[MAX_GROUP];
+		for(usafe_t i = 0; i < g; ++i){ ctx[i].occs.clear(); }
+		for(usafe_t s = 0; s <= segments.size(); ++s)
+		{
+			const stpd_index *index = s == 0 ? this : segments[s-1].index.get();
+			for(usafe_t i = 0; i < g; ++i)
+			{
+				w[i].b = ctx[i].occs.size();
+				w[i].limit = limit - w[i].b;
+				w[i].occ = w[i].limit > 0 ? index->first_occurrence(ctx[i].pattern) : -1;
+				if(s > 0){ w[i].limit = segment_limit(w[i].limit,segments[s-1]); }
+			}
+			index->exp_search_group(ctx,w,g);
+			if(s > 0)
+				for(usafe_t i = 0; i < g; ++i){ shift_occs(ctx[i].occs,w[i].b,limit-w[i].b,segments[s-1]); }
+		}
+	}
+
+	// locate all occurrences exponential search, in this index and in the appended segments;
+	// with a limit, the search stops after limit verified occurrences (limit > 0), so that
+	// it costs O(limit) phi steps instead of O(occ)
 	std::tuple<std::vector<uint_t>,double,double> 
-						 locate_pattern_exp_search(const std::string &pattern) const
+						 locate_pattern_exp_search(const std::string &pattern,
+						                           usafe_t limit = std::numeric_limits<usafe_t>::max()) const
 	{
-		auto start = std::chrono::high_resolution_clock::now();
+		auto o = locate_segment_exp_search(pattern,limit);
+		for(auto& seg : segments)
+		{
+			if(std::get<0>(o).size() >= limit){ break; }
+			usafe_t b = std::get<0>(o).size();
+			auto so = seg.index->locate_segment_exp_search(pattern,segment_limit(limit-b,seg));
+			std::get<0>(o).insert(std::get<0>(o).end(),std::get<0>(so).begin(),std::get<0>(so).end());
+			shift_occs(std::get<0>(o),b,limit-b,seg);
+			std::get<1>(o) += std::get<1>(so);
+			std::get<2>(o) += std::get<2>(so);
+		}
+		return o;
+	}
+
+private:
+
+	// header, offset, overlap and components of an appended segment, whose text oracle
+	// shares the reference of this one
+	usafe_t store_segment(std::ofstream &out, const segment &seg)
+	{
+		uint64_t header = SEGMENT_HEADER;
+		out.write((char*)&header,sizeof(header));
+		out.write((char*)&seg.offset,sizeof(seg.offset));
+		out.write((char*)&seg.overlap,sizeof(seg.overlap));
+		return sizeof(header) + sizeof(seg.offset) + sizeof(seg.overlap) + seg.index->O.serialize_shared(out)
+		       + seg.index->S.serialize(out) + seg.index->phi.serialize(out);
+	}
+
+	// number of occurrences to search in seg to find limit of them ending after its
+	// overlap: at most overlap occurrences end in it
+	static usafe_t segment_limit(usafe_t limit, const segment &seg)
+	{
+		return limit > std::numeric_limits<usafe_t>::max() - seg.overlap ? limit : limit + seg.overlap;
+	}
+
+	// drop the occurrences in res[b,end) found in seg that end in its overlap, which the
+	// previous indexes report, and shift the first limit others to text positions
+	static void shift_occs(std::vector<uint_t> &res, usafe_t b, usafe_t limit, const segment &seg)
+	{
+		usafe_t j = b;
+		for(usafe_t i = b; i < res.size() and j-b < limit; ++i)
+			if(res[i] >= seg.overlap){ res[j++] = res[i] + seg.offset; }
+		res.resize(j);
+	}
+
+	// oracle of the segment containing text position i after its overlap, and i in that segment
+	std::pair<const textOracle*,usafe_t> oracle_at(usafe_t i) const
+	{
+		for(auto seg = segments.rbegin(); seg != segments.rend(); ++seg)
+			if(i >= seg->offset + seg->overlap){ return std::make_pair(&seg->index->O, i - seg->offset); }
+		return std::make_pair(&O, i);
+	}
 
+	// candidate occurrence of pattern from which the phi chain of its occurrences
+	// starts, or -1 if pattern does not occur
+	int_t first_occurrence(const std::string &pattern) const
+	{
 		usafe_t m = pattern.size();
 		auto i_occ = this->S.locate_first_prefix(pattern);
-		bool_t mismatch_found;
+
+		if(i_occ.second < 0) // not even the first character occurs, e.g. in a segment
+			return -1;
 
 		while(i_occ.first-1 < m)
 		{
 			auto j = this->S.binary_search_lower_bound(pattern,0,i_occ.first);
-			mismatch_found = std::get<2>(j);
 
-			if(mismatch_found)
-				return std::make_tuple(std::vector<uint_t>{},0,0);
+			if(std::get<2>(j)) // mismatch found
+				return -1;
 
 			i_occ.second = std::get<0>(j);
 			usafe_t f = O.LCP(pattern,i_occ.first,i_occ.second+1);
 			i_occ.first = i_occ.first + f + 1;
 			i_occ.second = i_occ.second + f;
 		}
-		std::chrono::duration<double> duration_mid = 
-				std::chrono::high_resolution_clock::now() - start;
 
-		usafe_t high = 2, low = 0;
-		std::vector<uint_t> res{uint_t(i_occ.second)};
-		while(true)
+		return i_occ.second;
+	}
+
+	// append to res up to limit occurrences of pattern in this index, starting the phi
+	// chain from occ. res[b,low) are verified occurrences; each round extends res to high
+	// candidates with phi and verifies the last one, doubling the round up to limit
+	void exp_search(const std::string &pattern, int_t occ, usafe_t limit, std::vector<uint_t> &res) const
+	{
+		usafe_t m = pattern.size(), b = res.size();
+		usafe_t low = b, high = b + std::min(usafe_t(2),limit);
+		res.push_back(occ);
+		bool_t last = false;
+		while(low - b < limit)
 		{
-			usafe_t phi_steps = high/2;
-			while(phi_steps-- > 0)
+			while(res.size() < high and not (last = (occ = phi.phi_safe(occ)) == -1))
+				res.push_back(occ);
+			high = res.size();
+
+			if(last or O.LCS(pattern,m-1,res[high-1]) < m)
 			{
-				i_occ.second = phi.phi_safe(i_occ.second);
-				if(i_occ.second == -1)
-				{
-					high -= phi_steps;
-					binary_search_occs(low,high,m,pattern,res);
-					res.resize(low);
+				binary_search_occs(low,high,m,pattern,res.data());
+				break;
+			}
 
-					std::chrono::duration<double> duration = 
-							std::chrono::high_resolution_clock::now() - start;
+			low = high;
+			high = b + std::min(2*(high-b),limit);
+		}
+		res.resize(low);
+	}
+
+	// exp_search() of a query of locate_group(), advanced by exp_search_group()
+	struct phi_walk
+	{
+		int_t occ; // last position of the chain, -1 once the walk is over
+		usafe_t b, low, high, limit; // as in exp_search()
+		int stage; // prefetch stages issued for the next phi step
+	};
+
+	// exp_search() of g queries, interleaved: a visit to a query issues the next prefetch
+	// stage of its phi step (see r_index_phi_inv_intlv::prefetch()), or takes the step, and
+	// moves on to the next query, so that the memory accesses of the g walks overlap
+	void exp_search_group(query_context *ctx, phi_walk *w, usafe_t g) const
+	{
+		usafe_t active = 0;
+		for(usafe_t i = 0; i < g; ++i)
+			if(w[i].occ >= 0)
+			{
+				w[i].low = w[i].b;
+				w[i].high = w[i].b + std::min(usafe_t(2),w[i].limit);
+				w[i].stage = 0;
+				ctx[i].occs.push_back(w[i].occ);
+				active++;
+			}
+
+		while(active > 0)
+			for(usafe_t i = 0; i < g; ++i)
+			{
+				phi_walk &q = w[i];
+				if(q.occ < 0){ continue; }
+				std::vector<uint_t> &res = ctx[i].occs;
+				bool_t last = false;
 
-					return std::make_tuple(res,duration.count(),duration_mid.count());			
+				if(res.size() < q.high)
+				{
+					if(q.stage < phiFunction::PREFETCH_STAGES){ phi.prefetch(q.occ,q.stage++); continue; }
+					q.stage = 0;
+					if(not (last = (q.occ = phi.phi_safe(q.occ)) == -1)){ res.push_back(q.occ); }
+					if(not last and res.size() < q.high){ continue; }
 				}
 
-				res.push_back(i_occ.second);
+				// the round is complete: verify its last candidate
+				const std::string &pattern = ctx[i].pattern;
+				usafe_t m = pattern.size();
+				q.high = res.size();
+				if(last or O.LCS(pattern,m-1,res[q.high-1]) < m)
+				{
+					binary_search_occs(q.low,q.high,m,pattern,res.data());
+				}
+				else
+				{
+					q.low = q.high;
+					q.high = q.b + std::min(2*(q.high-q.b),q.limit);
+					if(q.low - q.b < q.limit){ continue; }
+				}
+				res.resize(q.low);
+				q.occ = -1;
+				active--;
 			}
+	}
 
-			usafe_t f = O.LCS(pattern,m-1,res[high-1]);
-			if(f < m)
-				break;
+	// locate all occurrences exponential search in this index only
+	std::tuple<std::vector<uint_t>,double,double> 
+						 locate_segment_exp_search(const std::string &pattern, usafe_t limit) const
+	{
+		auto start = std::chrono::high_resolution_clock::now();
 
-			low = high;
-			high *= 2;
-		}
+		int_t occ = first_occurrence(pattern);
 
-		binary_search_occs(low,high,m,pattern,res);
-		res.resize(low);
+		if(occ < 0)
+			return std::make_tuple(std::vector<uint_t>{},0,0);
+
+		std::chrono::duration<double> duration_mid = 
+				std::chrono::high_resolution_clock::now() - start;
+
+		std::vector<uint_t> res;
+		exp_search(pattern,occ,limit,res);
 
 		std::chrono::duration<double> duration = 
 				std::chrono::high_resolution_clock::now() - start;
 
 		return std::make_tuple(res,duration.count(),duration_mid.count());
 	}
+
+public:
+
 	/*
 	std::tuple<std::vector<uint_t>,double,double> 
 						 locate_pattern(const std::string pattern) const
@@ -228,64 +844,173 @@ public:
 		Note that the check_occs_correctness function assumes that each pattern 
 		occurs at least once in the text.
 	*/
-	void locate_fasta(const std::string patternFile, usafe_t thr) const
+	void locate_fasta(const std::string patternFile, usafe_t thr, usafe_t threads = 1, usafe_t group = 1) const
 	{
+		group = std::max(usafe_t(1),std::min(group,usafe_t(MAX_GROUP)));
+		if(threads > 1){ locate_fasta_parallel(patternFile,thr,threads,group); return; }
+
 		std::ifstream patterns(patternFile);
 		std::ofstream   output(patternFile+".occs");
 
-		std::string line, header;
-		usafe_t i=0, c=0;
-		std::tuple<std::vector<uint_t>,double,double> o;
+		std::vector<query_context> ctx(group);
+		usafe_t n=0, c=0, alloc_queries=0, max_m = max_pattern_length();
 		double tot_duration = 0;
 
 		malloc_count_reset_peak();
 
 		uint_t tot_occs = 0;
-		while(std::getline(patterns, line))
+		while(true)
 		{
-			if(i%2 != 0)
+			usafe_t g = 0;
+			while(g < group and std::getline(patterns, ctx[g].header) and std::getline(patterns, ctx[g].pattern)){ g++; }
+			if(g == 0){ break; }
+			for(usafe_t i = 0; i < g; ++i){ check_pattern_length(ctx[i].header,ctx[i].pattern,max_m); }
+
+			usafe_t allocs = malloc_count_num_allocs();
+			auto start = std::chrono::high_resolution_clock::now();
+
+			if(group > 1){ locate_group(ctx.data(),g,thr > 0 ? thr : std::numeric_limits<usafe_t>::max()); }
+			else{ locate(ctx[0].pattern,ctx[0],thr > 0 ? thr : std::numeric_limits<usafe_t>::max()); }
+
+			std::chrono::duration<double> duration = 
+					std::chrono::high_resolution_clock::now() - start;
+			alloc_queries += malloc_count_num_allocs() != allocs;
+
+			for(usafe_t i = 0; i < g; ++i)
 			{
-				//if(this->S.is_index_large())
-				//	o = locate_pattern(line);
-				//else
-					o = locate_pattern_exp_search(line);
+				write_occs(output,ctx[i].header,ctx[i].occs.data(),ctx[i].occs.data()+ctx[i].occs.size(),thr);
+				c += ctx[i].pattern.size();
+				tot_occs += ctx[i].occs.size();
+			}
+			tot_duration += duration.count();
+			n += g;
+		}
+
+		patterns.close();
+		output.close();
+
+		std::cout << "Memory peak while running pattern matching queries = " <<
+				     malloc_count_peak() << " bytes" << std::endl
+		          << "Elapsed time while running pattern matching queries = " <<
+				     tot_duration << " sec" << std::endl 
+		          << "Number of patterns = " << n 
+		 		  << ", Total number of characters = " << c << std::endl
+				  << "Total number of occurrences found = " << tot_occs << std::endl
+		          << "Queries with interleaved phi walks = " << group << std::endl
+		          << (group > 1 ? "Query groups" : "Queries") << " allocating heap memory (growing the query buffers) = " << alloc_queries << std::endl
+		          << "Elapsed time per pattern = " <<
+				     (tot_duration/n)*1000000000 << " nanoSec" << std::endl
+		          << "Elapsed time per character = " <<
+				     (tot_duration/(c))*1000000000 << " nanoSec" << std::endl
+		          << "Elapsed time per occurrence = " <<
+				     (tot_duration/(tot_occs))*1000000000 << " nanoSec" << std::endl;
+	}
+
+	// locate_fasta() with the patterns spread over threads threads. The patterns are read
+	// in batches; the threads of a batch take chunks of patterns from a shared counter, so
+	// that threads with short queries take more chunks, and store the occurrences by
+	// pattern, which are then written in input order
+	void locate_fasta_parallel(const std::string patternFile, usafe_t thr, usafe_t threads, usafe_t group) const
+	{
+		std::ifstream patterns(patternFile);
+		std::ofstream   output(patternFile+".occs");
 
-				output << header << std::endl;
-				if(std::get<0>(o).size() >= 0)
-				{	
-					usafe_t j=0;
-					for(auto& e:std::get<0>(o))
+		// per-thread query buffers, and the occurrences found by the thread in the batch
+		struct worker_state
+		{
+			std::vector<query_context> ctx;
+			std::vector<uint_t> found;
+			double busy = 0; // query time
+		};
+		// occurrences of a pattern: found[begin,end) of thread t
+		struct span{ usafe_t t, begin, end; };
+
+		const usafe_t batch = 1<<16, chunk = 64;
+		std::vector<std::string> headers(batch), lines(batch);
+		std::vector<span> spans(batch);
+		std::vector<worker_state> state(threads);
+		for(auto& st : state){ st.ctx.resize(group); }
+		usafe_t n = 0, c = 0, tot_occs = 0, max_m = max_pattern_length();
+
+		malloc_count_reset_peak();
+		auto start = std::chrono::high_resolution_clock::now();
+
+		usafe_t size = batch;
+		while(size == batch)
+		{
+			size = 0;
+			while(size < batch and std::getline(patterns,headers[size]) and std::getline(patterns,lines[size]))
+			{
+				check_pattern_length(headers[size],lines[size],max_m);
+				size++;
+			}
+
+			std::atomic<usafe_t> next(0);
+			auto worker = [&](usafe_t t){
+				worker_state& st = state[t];
+				st.found.clear();
+				for(usafe_t b = next.fetch_add(chunk); b < size; b = next.fetch_add(chunk))
+					for(usafe_t k = b; k < std::min(b+chunk,size); k += group)
 					{
-						output << e << " ";
-						if(++j > thr-1) break;
+						usafe_t g = std::min(group,std::min(b+chunk,size)-k);
+						auto start = std::chrono::high_resolution_clock::now();
+						if(group > 1)
+						{
+							for(usafe_t i = 0; i < g; ++i){ st.ctx[i].pattern = lines[k+i]; }
+							locate_group(st.ctx.data(),g,thr > 0 ? thr : std::numeric_limits<usafe_t>::max());
+						}
+						else{ locate(lines[k],st.ctx[0],thr > 0 ? thr : std::numeric_limits<usafe_t>::max()); }
+						std::chrono::duration<double> duration = 
+								std::chrono::high_resolution_clock::now() - start;
+						st.busy += duration.count();
+						for(usafe_t i = 0; i < g; ++i)
+						{
+							spans[k+i] = span{t, st.found.size(), st.found.size() + st.ctx[i].occs.size()};
+							st.found.insert(st.found.end(),st.ctx[i].occs.begin(),st.ctx[i].occs.end());
+						}
 					}
-					output << std::endl;
-				}
+			};
+			std::vector<std::thread> pool;
+			for(usafe_t t = 1; t < threads; ++t){ pool.emplace_back(worker,t); }
+			worker(0);
+			for(auto& w : pool){ w.join(); }
 
-				tot_duration += std::get<1>(o);
-				c += line.size();
-				tot_occs += std::get<0>(o).size();
+			for(usafe_t k = 0; k < size; ++k)
+			{
+				const uint_t* found = state[spans[k].t].found.data();
+				write_occs(output,headers[k],found+spans[k].begin,found+spans[k].end,thr);
+				c += lines[k].size();
+				tot_occs += spans[k].end - spans[k].begin;
 			}
-			else{ header = line; }
-			i++;
+			n += size;
 		}
 
 		patterns.close();
 		output.close();
 
+		std::chrono::duration<double> wall = std::chrono::high_resolution_clock::now() - start;
+		double tot_duration = 0;
+		for(auto& st : state){ tot_duration += st.busy; }
+
 		std::cout << "Memory peak while running pattern matching queries = " <<
 				     malloc_count_peak() << " bytes" << std::endl
 		          << "Elapsed time while running pattern matching queries = " <<
-				     tot_duration << " sec" << std::endl 
-		          << "Number of patterns = " << i/2 
+				     tot_duration << " sec (summed over " << threads << " threads)" << std::endl 
+		          << "Number of patterns = " << n 
 		 		  << ", Total number of characters = " << c << std::endl
 				  << "Total number of occurrences found = " << tot_occs << std::endl
+		          << "Queries with interleaved phi walks = " << group << std::endl
 		          << "Elapsed time per pattern = " <<
-				     (tot_duration/(i/2))*1000000000 << " nanoSec" << std::endl
+				     (tot_duration/n)*1000000000 << " nanoSec" << std::endl
 		          << "Elapsed time per character = " <<
 				     (tot_duration/(c))*1000000000 << " nanoSec" << std::endl
 		          << "Elapsed time per occurrence = " <<
-				     (tot_duration/(tot_occs))*1000000000 << " nanoSec" << std::endl;
+				     (tot_duration/(tot_occs))*1000000000 << " nanoSec" << std::endl
+		          << "Wall-clock time including input and output = " << wall.count() << " sec" << std::endl
+		          << "Aggregate throughput = " << n/wall.count() << " patterns/sec, " <<
+				     tot_occs/wall.count() << " occurrences/sec" << std::endl
+		          << "Scaling efficiency (query time / (threads x wall-clock time)) = " <<
+				     tot_duration/(threads*wall.count())*100 << "%" << std::endl;
 	}
 
 	// check running time and correctness of locating all occurrences queries
@@ -352,6 +1077,31 @@ public:
 
 private:
 
+	// exit if the occurrences of pattern across the segment boundaries could be missed
+	static void check_pattern_length(const std::string& header, const std::string& pattern, usafe_t max_m)
+	{
+		if(pattern.size() > max_m)
+		{
+			std::cerr << "Error: pattern " << header << " is longer than " << max_m << " characters, the longest "
+			          << "pattern found across the appended segments (see -L of build_store_stpd_index)" << std::endl;
+			exit(1);
+		}
+	}
+
+	// write the header and the first thr occurrences of a pattern
+	static void write_occs(std::ostream& output, const std::string& header,
+	                       const uint_t* begin, const uint_t* end, usafe_t thr)
+	{
+		output << header << "\n";
+		usafe_t j=0;
+		for(auto e = begin; e != end; ++e)
+		{
+			output << *e << " ";
+			if(++j > thr-1) break;
+		}
+		output << "\n";
+	}
+
 	bool check_occs_correctness(const std::vector<uint_t>& occs, const std::string& patt) const
 	{	
 		if(occs.size() == 0)
@@ -361,7 +1111,8 @@ private:
 		}
 		for(const auto& e : occs)
 		{
-			uint_t lcs = O.LCS(patt,patt.size()-1,e);
+			auto o = oracle_at(e);
+			uint_t lcs = o.first->LCS(patt,patt.size()-1,o.second);
 			if(lcs != patt.size())
 			{
 				std::cerr << "Error detected with pattern: " << patt << " and occ " << e << std::endl;
@@ -373,7 +1124,7 @@ private:
 	}
 
 	inline void binary_search_occs(usafe_t& low, usafe_t& high, usafe_t m, 
-		                      const std::string& pattern, const std::vector<uint_t>& res) const
+		                      const std::string& pattern, const uint_t* res) const
 	{
 		usafe_t mid = (low+high)/2;
 		while( low < high )
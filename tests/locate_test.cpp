@@ -0,0 +1,350 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  locate_test: builds indexes of a small DNA collection with build_store_stpd_index
+ *  and checks the occurrences reported by locate against a scan of the text.
+ *  The indexes are built
+ *  - in one go,
+ *  - with -t 3,
+ *  - with -I, from the outputs of stpd_small converted to 5 and 8-byte inputs,
+ *  - with -R, from a checkpoint of an interrupted build with a damaged phase,
+ *  - with -P, whose JSON report is checked for the construction phases,
+ *  - in segments appended with -a.
+ *  locate also runs with -t 3, -T 3 and -G.
+ *  The occurrences of locate_cursor() are read with next() and next_block().
+ *  A second pass of locate() and locate_group() over the patterns on warmed
+ *  query contexts must not allocate.
+ *  Usage: locate_test <build_store_stpd_index> <locate> <stpd_small>
+ *  (with -DM64, the 64-bit index executables)
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "stpd-index.hpp"
+
+typedef stpd::stpd_index<stpd::stpd_array_binary_search_opt<>,
+                         RLZ_DNA_sux<>,stpd::r_index_phi_inv_intlv> index_t;
+
+int failures = 0;
+
+void fail( const std::string& what )
+{
+    std::cerr << "FAILED: " << what << std::endl;
+    failures++;
+}
+
+// exit status of command, with its output in log
+int run_status( const std::string& command, const std::string& log = "/dev/null" )
+{
+    return std::system( ( command + " > " + log + " 2>&1" ).c_str() );
+}
+
+void run( const std::string& command, const std::string& log = "/dev/null" )
+{
+    if( run_status( command, log ) != 0 ) {
+        std::cerr << "Error: " << command << " failed" << std::endl;
+        exit(1);
+    }
+}
+
+void write_file( const std::string& path, const std::string& data )
+{
+    std::ofstream out( path, std::ios::binary );
+    out << data;
+}
+
+std::string read_file( const std::string& path )
+{
+    std::ifstream in( path, std::ios::binary );
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// copies of a random sequence with one mismatch per 200 characters
+std::string collection( size_t n, size_t copies, std::mt19937& gen )
+{
+    const char* ACGT = "ACGT";
+    std::string base;
+    for( size_t i = 0; i < n / copies; ++i ) base.push_back( ACGT[ gen() % 4 ] );
+    std::string text = base;
+    while( text.size() < n ) {
+        std::string s = base;
+        for( size_t k = 0; k < s.size() / 200; ++k ) s[ gen() % s.size() ] = ACGT[ gen() % 4 ];
+        text += s;
+    }
+    return text.substr( 0, n );
+}
+
+// sorted end positions of the occurrences of pattern in text
+std::vector<uint64_t> scan( const std::string& text, const std::string& pattern )
+{
+    std::vector<uint64_t> occs;
+    for( size_t i = text.find( pattern ); i != std::string::npos; i = text.find( pattern, i+1 ) )
+        occs.push_back( i + pattern.size() - 1 );
+    return occs;
+}
+
+// occurrences of each pattern in the .occs file written by locate
+std::vector< std::vector<uint64_t> > read_occs( const std::string& path )
+{
+    std::vector< std::vector<uint64_t> > res;
+    std::ifstream in( path );
+    std::string header, line;
+    while( std::getline( in, header ) and std::getline( in, line ) ) {
+        std::istringstream ss( line );
+        res.emplace_back();
+        for( uint64_t x; ss >> x; ) res.back().push_back( x );
+    }
+    return res;
+}
+
+// the -I inputs prefix.* with w-byte integers, from the samples file and the text.pa,
+// .lcs and .rbwt files of stpd_small -P (5-byte integers): the runs of the reversed BWT,
+// the (position, PA) pairs at their boundaries and the (sample, LCS) pairs in colex order
+void convert( const std::string& samples_file, const std::string& text, const std::string& prefix, int w )
+{
+    std::string samples = read_file( samples_file ), pa = read_file( text + ".pa" ),
+                lcs = read_file( text + ".lcs" ), rbwt = read_file( text + ".rbwt" );
+    auto get = []( const std::string& s, size_t i ) { uint64_t x = 0; std::memcpy( &x, s.data() + 5*i, 5 ); return x; };
+    std::ofstream heads( prefix + ".bwt.heads", std::ios::binary ), lens( prefix + ".bwt.len", std::ios::binary ),
+                  ssa( prefix + ".ssa", std::ios::binary ), esa( prefix + ".esa", std::ios::binary ),
+                  stpd( prefix + ".stpd", std::ios::binary );
+    auto put = [w]( std::ofstream& out, uint64_t x ) { out.write( (const char*)&x, w ); };
+
+    size_t n = rbwt.size(), k = 0, start = 0;
+    for( size_t i = 0; i < n; ++i ) {
+        uint64_t x = get( pa, i );
+        // the samples are in the colex order of the prefixes ending at them
+        if( k < samples.size() / 5 and get( samples, k ) == x-1 ) { put( stpd, x-1 ); put( stpd, get( lcs, i ) ); ++k; }
+        if( i == 0 or rbwt[i] != rbwt[i-1] ) { heads.put( rbwt[i] ); put( ssa, i ); put( ssa, x ); start = i; }
+        if( i+1 == n or rbwt[i+1] != rbwt[i] ) { put( lens, i+1-start ); put( esa, i ); put( esa, x ); }
+    }
+    if( k != samples.size() / 5 ) fail( "-I: the samples of " + samples_file + " are not in colex order" );
+}
+
+// the phases of the JSON report of build_store_stpd_index -P, which must all have a
+// peak heap (malloc_count is linked) and the given phases an output size
+void check_profile( const std::string& path, const std::vector<std::string>& phases,
+                    const std::vector<std::string>& outputs )
+{
+    std::string json = read_file( path );
+    auto field = [&]( size_t from, const std::string& key, double& value ) {
+        size_t i = json.find( "\"" + key + "\": ", from );
+        if( i == std::string::npos ) return false;
+        char* end;
+        const char* s = json.c_str() + i + key.size() + 4;
+        value = std::strtod( s, &end );
+        return end != s and value >= 0;
+    };
+    double value;
+    for( auto& phase : phases ) {
+        size_t i = json.find( "{\"name\": \"" + phase + "\"" );
+        if( i == std::string::npos ) { fail( "-P: no phase " + phase + " in " + path ); continue; }
+        for( std::string key : { "wall_s", "cpu_s", "peak_heap_bytes", "read_bytes", "written_bytes", "output_bytes" } )
+            if( not field( i, key, value ) ) fail( "-P: phase " + phase + " has no " + key );
+        if( std::find( outputs.begin(), outputs.end(), phase ) != outputs.end() and
+            ( not field( i, "output_bytes", value ) or value == 0 ) )
+            fail( "-P: phase " + phase + " has no output size" );
+    }
+    if( not field( 0, "total_wall_s", value ) ) fail( "-P: no total_wall_s" );
+    if( not field( 0, "peak_rss_bytes", value ) or value == 0 ) fail( "-P: no peak_rss_bytes" );
+}
+
+// runs locate on the patterns of lt.fasta with the index and checks the occurrences
+void check_index( const std::string& index, const std::string& locate, const std::vector<std::string>& patterns,
+                  const std::vector< std::vector<uint64_t> >& expected )
+{
+    for( std::string options : { "", "-G 8", "-T 3", "-T 3 -G 4" } ) {
+        std::string what = "locate -i " + index + " " + options;
+        std::remove( "lt.fasta.occs" );
+        run( locate + " -i " + index + " -p lt.fasta " + options );
+        auto occs = read_occs( "lt.fasta.occs" );
+        if( occs.size() != patterns.size() ) { fail( what + ": wrong number of patterns" ); continue; }
+        for( size_t k = 0; k < patterns.size(); ++k ) {
+            std::sort( occs[k].begin(), occs[k].end() );
+            if( occs[k] != expected[k] ) fail( what + ": pattern p" + std::to_string(k) );
+        }
+    }
+
+    // -t 3: at most 3 of the occurrences, for each pattern
+    std::remove( "lt.fasta.occs" );
+    run( locate + " -i " + index + " -p lt.fasta -t 3 -G 4" );
+    auto occs = read_occs( "lt.fasta.occs" );
+    for( size_t k = 0; k < patterns.size() and k < occs.size(); ++k ) {
+        bool ok = occs[k].size() == std::min( expected[k].size(), size_t(3) );
+        for( uint64_t x : occs[k] )
+            ok = ok and std::binary_search( expected[k].begin(), expected[k].end(), x );
+        if( not ok ) fail( "locate -i " + index + " -t 3: pattern p" + std::to_string(k) );
+    }
+    if( occs.size() != patterns.size() ) fail( "locate -i " + index + " -t 3: wrong number of patterns" );
+
+    // the occurrences of locate_cursor(), one at a time and in blocks
+    index_t idx;
+    idx.load( index );
+    for( size_t k = 0; k < patterns.size(); ++k ) {
+        std::vector<uint64_t> one, blocks;
+        auto c = idx.locate_cursor( patterns[k] );
+        for( uint_t occ; c.next( occ ); ) one.push_back( occ );
+        auto d = idx.locate_cursor( patterns[k] );
+        uint_t buf[7];
+        for( usafe_t n; ( n = d.next_block( buf, 1 + k % 7 ) ) > 0; ) blocks.insert( blocks.end(), buf, buf + n );
+        std::sort( one.begin(), one.end() );
+        std::sort( blocks.begin(), blocks.end() );
+        if( one != expected[k] or blocks != expected[k] )
+            fail( "locate_cursor on " + index + ": pattern p" + std::to_string(k) );
+    }
+
+    // locate() on a query context: the second pass over the patterns finds the buffers
+    // grown to the largest query and allocates no heap memory
+    index_t::query_context ctx;
+    for( int pass = 0; pass < 2; ++pass ) {
+        size_t allocs = malloc_count_num_allocs();
+        bool ok = true;
+        for( size_t k = 0; k < patterns.size(); ++k ) {
+            idx.locate( patterns[k], ctx );
+            std::sort( ctx.occs.begin(), ctx.occs.end() );
+            ok = ok and ctx.occs.size() == expected[k].size() and
+                 std::equal( ctx.occs.begin(), ctx.occs.end(), expected[k].begin() );
+        }
+        if( not ok ) fail( "locate() on " + index + ": wrong occurrences" );
+        if( pass == 1 and malloc_count_num_allocs() != allocs )
+            fail( "locate() on " + index + ": " + std::to_string( malloc_count_num_allocs() - allocs ) +
+                  " allocations with a warmed query_context" );
+    }
+
+    // the same for locate_group() on groups of 8 queries
+    std::vector<index_t::query_context> group( 8 );
+    for( int pass = 0; pass < 2; ++pass ) {
+        size_t allocs = malloc_count_num_allocs();
+        bool ok = true;
+        for( size_t k = 0; k < patterns.size(); k += group.size() ) {
+            size_t g = std::min( group.size(), patterns.size() - k );
+            for( size_t i = 0; i < g; ++i ) group[i].pattern = patterns[k+i];
+            idx.locate_group( group.data(), g );
+            for( size_t i = 0; i < g; ++i ) {
+                auto& occs = group[i].occs;
+                std::sort( occs.begin(), occs.end() );
+                ok = ok and occs.size() == expected[k+i].size() and
+                     std::equal( occs.begin(), occs.end(), expected[k+i].begin() );
+            }
+        }
+        if( not ok ) fail( "locate_group() on " + index + ": wrong occurrences" );
+        if( pass == 1 and malloc_count_num_allocs() != allocs )
+            fail( "locate_group() on " + index + ": " + std::to_string( malloc_count_num_allocs() - allocs ) +
+                  " allocations with warmed query contexts" );
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    if( argc < 4 ) {
+        std::cerr << "Usage: locate_test <build_store_stpd_index> <locate> <stpd_small>" << std::endl;
+        return 1;
+    }
+    std::string build = argv[1], locate = argv[2], stpd_small = argv[3];
+
+    std::mt19937 gen( 1 );
+    std::string text = collection( 60000, 5, gen );
+    const size_t cuts[] = { 25000, 41000 };
+
+    // substrings of the text, some across the cuts of the segments, and random patterns
+    std::vector<std::string> patterns;
+    const size_t lengths[] = { 1, 2, 5, 10, 20, 50, 100 };
+    for( size_t k = 0; k < 280; ++k ) {
+        size_t m = lengths[ k % 7 ], p = gen() % ( text.size() - m );
+        if( k % 4 == 0 ) p = cuts[ k % 8 == 0 ] - 1 - gen() % m;
+        patterns.push_back( text.substr( p, m ) );
+    }
+    for( size_t k = 0; k < 20; ++k ) {
+        std::string p;
+        for( size_t i = 0; i < 16; ++i ) p.push_back( "ACGT"[ gen() % 4 ] );
+        patterns.push_back( p );
+    }
+    // patterns ending in a run of T's absent from the text, whose keys are larger than
+    // all the keys of the Elias-Fano sequences
+    patterns.push_back( std::string( 40, 'T' ) );
+    patterns.push_back( text.substr( 30000, 20 ) + std::string( 40, 'T' ) );
+    std::vector< std::vector<uint64_t> > expected;
+    {
+        std::ofstream fasta( "lt.fasta" );
+        for( size_t k = 0; k < patterns.size(); ++k ) {
+            fasta << ">p" << k << "\n" << patterns[k] << "\n";
+            expected.push_back( scan( text, patterns[k] ) );
+        }
+    }
+
+    write_file( "lt.txt", text );
+    run( build + " -i lt.txt -o lt.ci" );
+    run( build + " -i lt.txt -o lt.t3.ci -t 3" );
+
+    // -I from the outputs of stpd_small, with 5-byte integers and the oracle built from
+    // the text, and with 8-byte integers and a serialized oracle
+    run( stpd_small + " -i lt.txt -o lt.samples -c -P" );
+    convert( "lt.samples", "lt.txt", "lt.I5", 5 );
+    convert( "lt.samples", "lt.txt", "lt.I8", 8 );
+    {
+        RLZ_DNA_sux<> O;
+        O.build( "lt.txt" );
+        std::ofstream out( "lt.I8.rlz", std::ios::binary );
+        O.serialize( out );
+    }
+    run( build + " -i lt.txt -o lt.I5.ci -I lt.I5" );
+    run( build + " -i lt.txt -o lt.I8.ci -I lt.I8 -w 8" );
+
+    // -R: a directory in place of the checkpoint file of the phi function stops the first
+    // build after the path decomposition, oracle and STPD-array phases. With the
+    // STPD-array checkpoint damaged, the second build reuses the first two phases only
+    std::remove( "lt.R.ci.ckpt.manifest" );
+    run( "mkdir -p lt.R.ci.ckpt.phi" );
+    if( run_status( build + " -i lt.txt -o lt.R.ci -R" ) == 0 ) fail( "-R: the build did not stop" );
+    std::remove( "lt.R.ci.ckpt.phi" );
+    {
+        std::fstream f( "lt.R.ci.ckpt.stpd_array", std::ios::binary | std::ios::in | std::ios::out );
+        f.seekp( 100 );
+        f.put( '\x5a' );
+    }
+    run( build + " -i lt.txt -o lt.R.ci -R", "lt.R.log" );
+    std::string messages = read_file( "lt.R.log" );
+    for( std::string line : { "[RESUME] Phase pd is complete", "[RESUME] Phase oracle is complete",
+                              "[RESUME] Phase stpd_array has damaged outputs and is rebuilt" } )
+        if( messages.find( line ) == std::string::npos ) fail( "-R: no \"" + line + "\"" );
+    if( std::ifstream( "lt.R.ci.ckpt.manifest" ) ) fail( "-R: the checkpoint is not removed" );
+
+    // -P: the index is unchanged and every phase is reported
+    run( build + " -i lt.txt -o lt.P.ci -P lt.P.json" );
+    check_profile( "lt.P.json", { "SA", "PA", "LCP", "sampling", "LCS", "stream", "RLZ parse", "EF build", "phi build", "serialize" },
+                   { "SA", "PA", "RLZ parse", "EF build", "phi build" } );
+
+    write_file( "lt.a.txt", text.substr( 0, cuts[0] ) );
+    write_file( "lt.b.txt", text.substr( cuts[0], cuts[1] - cuts[0] ) );
+    write_file( "lt.c.txt", text.substr( cuts[1] ) );
+    run( build + " -i lt.a.txt -o lt.seg.ci" );
+    run( build + " -i lt.b.txt -o lt.seg.ci -a" );
+    run( build + " -i lt.c.txt -o lt.seg.ci -a -t 3" );
+
+    for( std::string index : {
+        "lt.ci",
+        "lt.t3.ci",
+        "lt.I5.ci", "lt.I8.ci",
+        "lt.R.ci",
+        "lt.P.ci",
+        "lt.seg.ci",
+    } )
+        check_index( index, locate, patterns, expected );
+
+    if( failures > 0 ) { std::cerr << failures << " checks failed" << std::endl; return 1; }
+    std::cout << "locate: all checks passed" << std::endl;
+    return 0;
+}
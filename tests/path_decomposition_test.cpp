@@ -0,0 +1,267 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  path_decomposition_test: the samples and the PA, LCS and reversed BWT files of
+ *  stpd_small (with each construction option) and of the path_decomposition class with
+ *  64-bit arrays against the original construction from an explicit suffix tree, on
+ *  small DNA texts
+ *  Usage: path_decomposition_test <stpd_small>
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <stack>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sdsl/construct.hpp>
+
+#include <path_decomposition.hpp>
+
+// contents of the four files written by stpd_small -P: samples, PA, LCS, reversed BWT
+struct outputs
+{
+    std::string samples, pa, lcs, rbwt;
+};
+
+// The construction of stpd_small before the SA/LCP sampling: explicit suffix tree
+// from SA and LCP, leaves visited in rank order and marked up to the first marked
+// ancestor, with naive SA and LCP computations
+namespace baseline{
+
+std::vector<int64_t> suffix_array( const std::string& T )
+{
+    std::vector<int64_t> sa( T.size() );
+    std::iota( sa.begin(), sa.end(), 0 );
+    std::sort( sa.begin(), sa.end(), [&]( int64_t a, int64_t b ) {
+        return T.compare( a, std::string::npos, T, b, std::string::npos ) < 0;
+    });
+    return sa;
+}
+
+// LCP[i] of the suffixes of T in the order sa (Kasai et al.)
+std::vector<int64_t> lcp_array( const std::string& T, const std::vector<int64_t>& sa )
+{
+    int64_t n = T.size();
+    std::vector<int64_t> isa( n ), lcp( n, 0 );
+    for( int64_t i = 0; i < n; ++i ) isa[ sa[i] ] = i;
+    int64_t m = 0;
+    for( int64_t i = 0; i < n-1; ++i ) {
+        int64_t j = sa[ isa[i]-1 ];
+        while( T[i+m] == T[j+m] ) ++m;
+        lcp[ isa[i] ] = m;
+        if( m > 0 ) --m;
+    }
+    return lcp;
+}
+
+void put( std::string& out, uint64_t x, int bytes ) { out.append( (const char*)&x, bytes ); }
+
+outputs run( std::string T, bool colexM, bool colexP, bool lexM, bool lexP )
+{
+    T.push_back( '\0' );
+    int64_t N = T.size();
+
+    std::string T_rev( N, '\0' );
+    for( int64_t i = 0; i < N-1; ++i ) T_rev[ N-2-i ] = T[i];
+
+    std::vector<int64_t> SA = suffix_array( T ), PA = suffix_array( T_rev );
+    std::vector<int64_t> ISA( N ), IPA( N );
+    for( int64_t i = 0; i < N; ++i ) { ISA[ SA[i] ] = i; IPA[ PA[i] ] = i; }
+    std::vector<int64_t> LCP = lcp_array( T, SA ), LCS = lcp_array( T_rev, PA );
+
+    std::vector< std::pair<int64_t,int64_t> > ST; // (parent, depth) of each node
+    std::vector<int64_t> STLeaf;                  // leaf of each suffix, in SA order
+    ST.push_back( std::make_pair( -1, 0 ) );
+    ST.push_back( std::make_pair(  0, 1 ) );
+    STLeaf.push_back( 1 );
+    std::stack<int64_t> stk;
+    stk.push(0);
+    stk.push(1);
+    for( int64_t i = 1; i < N; ++i ) {
+        int64_t last_u = stk.top();
+        while( !stk.empty() && ST[stk.top()].second > LCP[i] ) {
+            last_u = stk.top();
+            stk.pop();
+        }
+        if( ST[stk.top()].second != LCP[i] ) {
+            int64_t new_u = ST.size();
+            ST.push_back( std::make_pair( stk.top(), LCP[i] ) );
+            ST[last_u].first = new_u;
+            stk.push(new_u);
+        }
+        int64_t new_v = ST.size();
+        ST.push_back( std::make_pair( stk.top(), N-SA[i] ) );
+        stk.push(new_v);
+        STLeaf.push_back(new_v);
+    }
+
+    auto sampling = [&]( const std::vector<int64_t>& rank ) {
+        std::vector<int64_t> order( N );
+        for( int64_t i = 0; i < N; ++i ) order[ rank[i] ] = i;
+        std::vector<bool> marked( ST.size(), false );
+        std::set<int64_t> S;
+        for( int64_t i = 0; i < N; ++i ) {
+            int64_t j = ISA[ order[i] ], v = STLeaf[j];
+            while( v >= 0 && !marked[v] ) { marked[v] = true; v = ST[v].first; }
+            S.insert( v >= 0 ? SA[j] + ST[v].second : SA[j] );
+        }
+        return S;
+    };
+
+    std::vector<int64_t> colex( N ), colex_r( N ), lex_r( N );
+    for( int64_t i = 1; i < N; ++i ) { colex[ N-2-PA[i] ] = i; colex_r[ N-2-PA[i] ] = N-1-i; }
+    colex[N-1] = 0; colex_r[N-1] = N-1;
+    for( int64_t i = 0; i < N; ++i ) lex_r[i] = N-1-ISA[i];
+
+    std::set<int64_t> S;
+    if( colexM or colexP ) S = sampling( colex );
+    if( colexP ) { auto s = sampling( colex_r ); S.insert( s.begin(), s.end() ); }
+    if( lexM or lexP ) S = sampling( ISA );
+    if( lexP ) { auto s = sampling( lex_r ); S.insert( s.begin(), s.end() ); }
+
+    outputs out;
+    // samples sorted by the colex rank of the prefix ending at them
+    std::vector< std::pair<int64_t,int64_t> > stpd_array;
+    for( int64_t m : S )
+        if( m < N-1 ) stpd_array.push_back( std::make_pair( m, IPA[N-m-2] ) );
+    std::sort( stpd_array.begin(), stpd_array.end(), []( const std::pair<int64_t,int64_t>& a,
+                                                         const std::pair<int64_t,int64_t>& b ) {
+        return a.second < b.second;
+    });
+    for( auto& p : stpd_array ) put( out.samples, p.first, 5 );
+
+    for( int64_t i = 0; i < N; ++i ) {
+        int64_t x = N - PA[i] - 1;
+        put( out.pa, x, 5 );
+        put( out.lcs, LCS[i], 5 );
+        out.rbwt.push_back( T[x] );
+    }
+    return out;
+}
+
+} // namespace baseline
+
+std::string read_file( const std::string& path )
+{
+    std::ifstream in( path, std::ios::binary );
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// the samples file and the prefix.pa, .lcs and .rbwt files, removed once read
+outputs read_outputs( const std::string& samples, const std::string& prefix )
+{
+    outputs out{ read_file( samples ), read_file( prefix + ".pa" ),
+                 read_file( prefix + ".lcs" ), read_file( prefix + ".rbwt" ) };
+    for( std::string path : { samples, prefix + ".pa", prefix + ".rbwt", prefix + ".lcs" } ) std::remove( path.c_str() );
+    return out;
+}
+
+outputs stpd_small( const std::string& exe, const std::string& text, const std::string& flags,
+                    const std::string& options )
+{
+    { std::ofstream out( "pd_test.txt", std::ios::binary ); out << text; }
+    std::string command = exe + " -i pd_test.txt -o pd_test.samples -P -" + flags + " " + options + " > /dev/null";
+    if( std::system( command.c_str() ) != 0 ) {
+        std::cerr << "Error: " << command << " failed" << std::endl;
+        exit(1);
+    }
+    outputs out = read_outputs( "pd_test.samples", "pd_test.txt" );
+    std::remove( "pd_test.txt" );
+    return out;
+}
+
+template<class int_vector_t>
+outputs in_memory( const std::string& text, const std::string& flags )
+{
+    sdsl::int_vector<8> T( text.size() );
+    for( size_t i = 0; i < text.size(); ++i ) T[i] = text[i];
+    sdsl::append_zero_symbol( T );
+    stpd::path_decomposition<int_vector_t> pd( T );
+    pd.compute( flags == "c", flags == "C", flags == "l", flags == "L", true );
+    pd.store( "pd_test.samples", true, "pd_test.pa", "pd_test.rbwt", "pd_test.lcs" );
+    return read_outputs( "pd_test.samples", "pd_test" );
+}
+
+// random DNA of length n, or copies of a random sequence with one mismatch per
+// 200 characters if copies > 1
+std::string dna( size_t n, size_t copies, unsigned seed )
+{
+    std::mt19937 gen( seed );
+    const char* ACGT = "ACGT";
+    std::string base;
+    for( size_t i = 0; i < n / copies; ++i ) base.push_back( ACGT[ gen() % 4 ] );
+    std::string text = base;
+    while( text.size() < n ) {
+        std::string s = base;
+        for( size_t k = 0; k < s.size() / 200; ++k ) s[ gen() % s.size() ] = ACGT[ gen() % 4 ];
+        text += s;
+    }
+    return text.substr( 0, n );
+}
+
+int failures = 0;
+
+void check( const outputs& got, const outputs& exp, const std::string& what )
+{
+    const char* names[] = { "samples", "PA", "LCS", "reversed BWT" };
+    const std::string* g[] = { &got.samples, &got.pa, &got.lcs, &got.rbwt };
+    const std::string* e[] = { &exp.samples, &exp.pa, &exp.lcs, &exp.rbwt };
+    for( int k = 0; k < 4; ++k )
+        if( *g[k] != *e[k] ) {
+            std::cerr << "FAILED: " << what << ": " << names[k] << " differ" << std::endl;
+            failures++;
+        }
+}
+
+int main( int argc, char* argv[] )
+{
+    if( argc < 2 ) {
+        std::cerr << "Usage: path_decomposition_test <stpd_small>" << std::endl;
+        return 1;
+    }
+    std::string exe = argv[1];
+
+    std::vector< std::pair<std::string,std::string> > texts;
+    for( size_t n : { 1, 2, 3, 10, 100, 1000 } )
+        for( unsigned seed = 1; seed <= 3; ++seed )
+            texts.push_back( std::make_pair( "random " + std::to_string(n) + " seed " + std::to_string(seed), dna( n, 1, seed ) ) );
+    texts.push_back( std::make_pair( "homopolymer", std::string( 100, 'A' ) ) );
+    texts.push_back( std::make_pair( "periodic", dna( 1000, 250, 4 ) ) );
+    texts.push_back( std::make_pair( "5 copies", dna( 10000, 5, 5 ) ) );
+
+    std::vector<std::string> options = { "", "-t 3", "-f", "-m 1" };
+    for( auto& t : texts )
+        for( std::string flags : { "c", "C", "l", "L" } ) {
+            std::string what = t.first + " -" + flags;
+            outputs exp = baseline::run( t.second, flags == "c", flags == "C", flags == "l", flags == "L" );
+            for( auto& o : options )
+                check( stpd_small( exe, t.second, flags, o ), exp, what + ( o == "" ? "" : " " + o ) );
+            check( in_memory< sdsl::int_vector<64> >( t.second, flags ), exp, what + " (64-bit)" );
+        }
+
+    // several sort runs with -m 1
+    std::string text = dna( 200000, 4, 6 );
+    for( std::string flags : { "c", "l" } )
+        check( stpd_small( exe, text, flags, "-m 1" ), baseline::run( text, flags == "c", false, flags == "l", false ),
+               "200000 characters -" + flags + " -m 1" );
+    // the colex+ ranks grow in SA order on a homopolymer, so the sampling stack holds
+    // all the leaves and is moved to disk with -m 1
+    text = std::string( 20000, 'A' );
+    check( stpd_small( exe, text, "C", "-m 1" ), baseline::run( text, false, true, false, false ),
+           "homopolymer of 20000 characters -C -m 1" );
+
+    if( failures > 0 ) { std::cerr << failures << " checks failed" << std::endl; return 1; }
+    std::cout << "path decomposition: all checks passed" << std::endl;
+    return 0;
+}
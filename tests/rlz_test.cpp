@@ -0,0 +1,147 @@
+// Copyright (c) 2025, REGINDEX.  All rights reserved.
+// Use of this source code is governed
+// by a MIT license that can be found in the LICENSE file.
+
+/*
+ *  rlz_test: extract(), LCP() and LCS_char() of RLZ_DNA_sux against the text, for
+ *  references taken from the text prefix (given or chosen by the build), sampled
+ *  across the text (-r) and shared with another oracle (-a), before and after
+ *  serialization
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <random>
+#include <utility>
+
+#include <RLZ_DNA_sux.hpp>
+
+typedef RLZ_DNA_sux<> oracle_t;
+
+int failures = 0;
+
+void fail( const std::string& what )
+{
+    std::cerr << "FAILED: " << what << std::endl;
+    failures++;
+}
+
+// copies of a random sequence with one mismatch per 200 characters
+std::string collection( size_t n, size_t copies, std::mt19937& gen )
+{
+    const char* ACGT = "ACGT";
+    std::string base;
+    for( size_t i = 0; i < n / copies; ++i ) base.push_back( ACGT[ gen() % 4 ] );
+    std::string text = base;
+    while( text.size() < n ) {
+        std::string s = base;
+        for( size_t k = 0; k < s.size() / 200; ++k ) s[ gen() % s.size() ] = ACGT[ gen() % 4 ];
+        text += s;
+    }
+    return text.substr( 0, n );
+}
+
+sdsl::int_vector<8> to_int_vector( const std::string& s )
+{
+    sdsl::int_vector<8> v( s.size() );
+    for( size_t i = 0; i < s.size(); ++i ) v[i] = s[i];
+    return v;
+}
+
+// pattern around text position t with a few mismatches, and the position p of t in it
+std::pair<std::string,size_t> pattern_at( const std::string& T, size_t t, std::mt19937& gen )
+{
+    size_t before = gen() % 300, after = gen() % 300;
+    size_t b = t > before ? t - before : 0, e = std::min( T.size(), t + after + 1 );
+    std::string P = b < T.size() ? T.substr( b, e - b ) : std::string( 1 + gen() % 50, 'A' );
+    for( size_t k = gen() % 3; k > 0; --k ) P[ gen() % P.size() ] = "ACGT"[ gen() % 4 ];
+    return std::make_pair( P, std::min( t - b, P.size() - 1 ) );
+}
+
+void check( const oracle_t& O, const std::string& T, const std::string& what, std::mt19937& gen )
+{
+    if( O.text_length() != T.size() ) { fail( what + ": text length" ); return; }
+    for( size_t i = 0; i <= T.size(); ++i )
+        if( O.extract(i) != ( i < T.size() ? (unsigned char)T[i] : 0 ) ) { fail( what + ": extract(" + std::to_string(i) + ")" ); return; }
+
+    for( size_t k = 0; k < 20000; ++k ) {
+        size_t t = k < 4 ? ( k % 2 == 0 ? 0 : T.size() - 1 - k / 2 ) : gen() % ( T.size() + 2 );
+        auto q = pattern_at( T, t, gen );
+        const std::string& P = q.first;
+        size_t p = k % 2 == 0 ? q.second : gen() % P.size();
+
+        size_t lcp = 0;
+        while( t < T.size() and p+lcp < P.size() and t+lcp < T.size() and P[p+lcp] == T[t+lcp] ) ++lcp;
+        if( O.LCP( P, p, t ) != lcp ) { fail( what + ": LCP at " + std::to_string(t) ); return; }
+
+        size_t lcs = 0;
+        while( t < T.size() and lcs <= p and lcs <= t and P[p-lcs] == T[t-lcs] ) ++lcs;
+        char c = t < T.size() and lcs <= p and lcs <= t ? T[t-lcs] : (unsigned char)-1;
+        if( O.LCS_char( P, p, t ) != std::make_pair( lcs, c ) ) { fail( what + ": LCS_char at " + std::to_string(t) ); return; }
+    }
+}
+
+// the oracle loaded from its serialization; shared is the oracle of the reference of
+// an oracle serialized with serialize_shared()
+void check_loaded( oracle_t& O, const std::string& T, const std::string& what, std::mt19937& gen,
+                   const oracle_t* shared = nullptr )
+{
+    {
+        std::ofstream out( "rlz_test.rlz", std::ios::binary );
+        if( shared ) O.serialize_shared( out ); else O.serialize( out );
+    }
+    oracle_t L;
+    std::ifstream in( "rlz_test.rlz", std::ios::binary );
+    if( not L.load( in, shared ) ) { fail( what + ": load" ); return; }
+    check( L, T, what + " (loaded)", gen );
+    std::remove( "rlz_test.rlz" );
+}
+
+int main()
+{
+    std::mt19937 gen( 1 );
+    std::string T = collection( 200000, 5, gen );
+    sdsl::int_vector<8> text = to_int_vector( T );
+
+    oracle_t prefix;
+    prefix.build( text, size_t(40000) );
+    check( prefix, T, "prefix reference", gen );
+    check_loaded( prefix, T, "prefix reference", gen );
+
+    oracle_t parallel;
+    parallel.build( text, size_t(40000), 3 );
+    check( parallel, T, "prefix reference, 3 threads", gen );
+    check_loaded( parallel, T, "prefix reference, 3 threads", gen );
+
+    for( size_t threads : { 1, 3 } ) {
+        oracle_t chosen;
+        chosen.build( text, 1.0, 0, threads );
+        check( chosen, T, "chosen reference, " + std::to_string(threads) + " threads", gen );
+    }
+
+    oracle_t sampled;
+    sampled.sampled_reference = true;
+    sampled.build( text, size_t(40000) );
+    check( sampled, T, "sampled reference", gen );
+    check_loaded( sampled, T, "sampled reference", gen );
+
+    // the same parse from a text pointer, as for a memory mapped text
+    oracle_t mapped;
+    mapped.build( (const uint8_t*)T.data(), T.size(), size_t(40000), 3 );
+    check( mapped, T, "prefix reference of a text pointer", gen );
+
+    // a text parsed against the reference of the oracle of the text it is appended to
+    std::string U = collection( 100000, 2, gen ).substr( 0, 50000 ) + T.substr( 0, 50000 );
+    for( const oracle_t* base : { &prefix, &sampled } ) {
+        oracle_t shared;
+        shared.build( to_int_vector( U ), *base, 3 );
+        std::string what = base == &prefix ? "shared prefix reference" : "shared sampled reference";
+        check( shared, U, what, gen );
+        check_loaded( shared, U, what, gen, base );
+    }
+
+    if( failures > 0 ) { std::cerr << failures << " checks failed" << std::endl; return 1; }
+    std::cout << "RLZ: all checks passed" << std::endl;
+    return 0;
+}